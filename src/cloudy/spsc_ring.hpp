@@ -0,0 +1,2 @@
+#pragma once
+#include "../libcloudyserver/spsc_ring.hpp"
@@ -0,0 +1,602 @@
+#include "common.hpp"
+
+#include "runner.hpp"
+
+#include <mesh.pp/cryptoutility.hpp>
+
+#include <boost/program_options.hpp>
+#include <boost/asio.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <map>
+#include <algorithm>
+#include <exception>
+#include <utility>
+#include <cctype>
+#include <cstdlib>
+
+namespace program_options = boost::program_options;
+namespace asio = boost::asio;
+namespace chrono = std::chrono;
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::endl;
+using tcp = asio::ip::tcp;
+using cloudy_bench::json_number;
+using cloudy_bench::url_encode;
+
+namespace
+{
+bool process_command_line(int argc, char** argv,
+                          string& address,
+                          meshpp::private_key& pv_key,
+                          vector<string>& uris,
+                          string& uris_file,
+                          string& pattern,
+                          uint64_t& range_size,
+                          size_t& concurrency,
+                          double& rate,
+                          uint64_t& duration,
+                          string& output);
+
+class response
+{
+public:
+    int status = 0;
+    uint64_t bytes = 0;
+    //  of the whole file, from Content-Range of the range response
+    uint64_t full_size = 0;
+};
+
+//  a keep-alive http connection, opened again after the server closes it
+class connection
+{
+public:
+    connection(string const& _host, string const& _port)
+        : host(_host)
+        , port(_port)
+        , socket(io)
+    {}
+
+    //  false on a connection or protocol error
+    bool request(string const& text, response& result)
+    {
+        bool fresh = false;
+        if (false == socket.is_open())
+        {
+            if (false == connect())
+                return false;
+            fresh = true;
+        }
+
+        if (exchange(text, result))
+            return true;
+
+        //  the server may have closed the idle connection, the request is sent again once
+        if (fresh ||
+            false == connect())
+            return false;
+
+        return exchange(text, result);
+    }
+private:
+    bool connect()
+    {
+        close();
+
+        boost::system::error_code ec;
+        tcp::resolver resolver(io);
+        auto endpoints = resolver.resolve(host, port, ec);
+        if (ec)
+            return false;
+
+        asio::connect(socket, endpoints, ec);
+        if (ec)
+        {
+            close();
+            return false;
+        }
+
+        socket.set_option(tcp::no_delay(true), ec);
+        return true;
+    }
+
+    void close()
+    {
+        boost::system::error_code ec;
+        socket.close(ec);
+        buffer.consume(buffer.size());
+    }
+
+    bool exchange(string const& text, response& result)
+    {
+        boost::system::error_code ec;
+        asio::write(socket, asio::buffer(text), ec);
+        if (ec)
+        {
+            close();
+            return false;
+        }
+
+        size_t header_size = asio::read_until(socket, buffer, "\r\n\r\n", ec);
+        if (ec)
+        {
+            close();
+            return false;
+        }
+
+        string header(asio::buffers_begin(buffer.data()),
+                      asio::buffers_begin(buffer.data()) + std::ptrdiff_t(header_size));
+        buffer.consume(header_size);
+
+        uint64_t content_length = 0;
+        bool keep_alive = true;
+        if (false == parse_header(header, result, content_length, keep_alive))
+        {
+            close();
+            return false;
+        }
+
+        if (buffer.size() < content_length)
+        {
+            asio::read(socket, buffer, asio::transfer_exactly(size_t(content_length - buffer.size())), ec);
+            if (ec)
+            {
+                close();
+                return false;
+            }
+        }
+        buffer.consume(size_t(content_length));
+        result.bytes = content_length;
+
+        if (false == keep_alive)
+            close();
+
+        return true;
+    }
+
+    static bool parse_header(string const& header,
+                             response& result,
+                             uint64_t& content_length,
+                             bool& keep_alive)
+    {
+        std::istringstream stream(header);
+        string line;
+
+        //  HTTP/1.1 206 OK
+        if (false == static_cast<bool>(std::getline(stream, line)))
+            return false;
+        size_t pos = line.find(' ');
+        if (string::npos == pos ||
+            0 != line.find("HTTP/"))
+            return false;
+        result.status = std::atoi(line.c_str() + pos + 1);
+
+        bool has_length = false;
+        while (std::getline(stream, line))
+        {
+            if (false == line.empty() && line.back() == '\r')
+                line.pop_back();
+
+            pos = line.find(':');
+            if (string::npos == pos)
+                continue;
+
+            string name = line.substr(0, pos);
+            string value = line.substr(pos + 1);
+            std::transform(name.begin(), name.end(), name.begin(), [](char ch)
+            {
+                return char(std::tolower(static_cast<unsigned char>(ch)));
+            });
+
+            if (name == "content-length")
+            {
+                content_length = std::strtoull(value.c_str(), nullptr, 10);
+                has_length = true;
+            }
+            else if (name == "connection" &&
+                     string::npos != value.find("close"))
+                keep_alive = false;
+            else if (name == "content-range")
+            {
+                //  bytes 0-1048575/52428800
+                pos = value.rfind('/');
+                if (string::npos != pos)
+                    result.full_size = std::strtoull(value.c_str() + pos + 1, nullptr, 10);
+            }
+        }
+
+        //  nothing tells where the body ends but the server closing the connection
+        if (false == has_length)
+            keep_alive = false;
+
+        return true;
+    }
+
+    string host;
+    string port;
+    asio::io_context io;
+    tcp::socket socket;
+    asio::streambuf buffer;
+};
+
+//  one player. segment fetches every file whole, one after the other, as the adaptive
+//  streaming players do. range reads a file by consecutive ranges, as the players of
+//  the progressive mp4 do, and goes to the next file at the end
+class viewer
+{
+public:
+    bool range = false;
+    uint64_t range_size = 0;
+    vector<string> const* puris = nullptr;
+    //  signed for the session of this viewer, one per file
+    vector<string> tokens;
+    size_t uri_index = 0;
+    uint64_t offset = 0;
+
+    string next_request(string const& host) const
+    {
+        string result = "GET /storage?file=" + url_encode((*puris)[uri_index]) +
+                        "&authorization=" + tokens[uri_index] + " HTTP/1.1\r\n"
+                        "Host: " + host + "\r\n"
+                        "User-Agent: cloudy_loadgen\r\n"
+                        "Accept: */*\r\n";
+        if (range)
+            result += "Range: bytes=" + std::to_string(offset) + "-" + std::to_string(offset + range_size - 1) + "\r\n";
+        result += "\r\n";
+
+        return result;
+    }
+
+    void advance(response const& result)
+    {
+        if (range &&
+            result.status == 206 &&
+            offset + range_size < result.full_size)
+        {
+            offset += range_size;
+            return;
+        }
+
+        offset = 0;
+        uri_index = (uri_index + 1) % puris->size();
+    }
+};
+
+class statistics
+{
+public:
+    uint64_t requests = 0;
+    uint64_t connection_errors = 0;
+    uint64_t http_errors = 0;
+    uint64_t bytes = 0;
+    //  microseconds, of the successful requests
+    vector<uint64_t> latencies;
+    std::map<int, uint64_t> statuses;
+
+    void merge(statistics const& other)
+    {
+        requests += other.requests;
+        connection_errors += other.connection_errors;
+        http_errors += other.http_errors;
+        bytes += other.bytes;
+        latencies.insert(latencies.end(), other.latencies.begin(), other.latencies.end());
+        for (auto const& item : other.statuses)
+            statuses[item.first] += item.second;
+    }
+};
+
+//  in milliseconds, nearest rank of the sorted latencies
+double percentile(vector<uint64_t> const& latencies, double fraction)
+{
+    if (latencies.empty())
+        return 0;
+
+    size_t rank = size_t(fraction * double(latencies.size()) + 0.999999);
+    if (rank > 0)
+        --rank;
+    return double(latencies[std::min(rank, latencies.size() - 1)]) / 1000;
+}
+}
+
+int main(int argc, char** argv)
+{
+    meshpp::config::set_public_key_prefix("Cloudy-");
+
+    string address;
+    meshpp::random_seed seed;
+    meshpp::private_key pv_key = seed.get_private_key(0);
+    vector<string> uris;
+    string uris_file;
+    string pattern = "segment";
+    uint64_t range_size = 1024 * 1024;
+    size_t concurrency = 16;
+    double rate = 0;
+    uint64_t duration = 30;
+    string output;
+
+    if (false == process_command_line(argc, argv,
+                                      address,
+                                      pv_key,
+                                      uris,
+                                      uris_file,
+                                      pattern,
+                                      range_size,
+                                      concurrency,
+                                      rate,
+                                      duration,
+                                      output))
+        return 1;
+
+    try
+    {
+        if (false == uris_file.empty())
+        {
+            std::ifstream file(uris_file);
+            if (false == file.good())
+                throw std::runtime_error("cannot read " + uris_file);
+
+            string line;
+            while (std::getline(file, line))
+            {
+                if (false == line.empty() && line.back() == '\r')
+                    line.pop_back();
+                if (false == line.empty())
+                    uris.push_back(line);
+            }
+        }
+        if (uris.empty())
+            throw std::runtime_error("no storage uris to fetch");
+
+        size_t pos = address.rfind(':');
+        if (string::npos == pos)
+            throw std::runtime_error("address must be host:port, " + address);
+        string host = address.substr(0, pos);
+        string port = address.substr(pos + 1);
+
+        //  the tokens outlive the run, the signing is not part of the measurement
+        vector<viewer> viewers(concurrency);
+        for (size_t index = 0; index != viewers.size(); ++index)
+        {
+            auto& item = viewers[index];
+            item.range = (pattern == "range") ||
+                         (pattern == "mixed" && index % 2 == 1);
+            item.range_size = range_size;
+            item.puris = &uris;
+            //  the viewers don't start on the same file
+            item.uri_index = index % uris.size();
+
+            string session_id = "cloudy_loadgen_" + std::to_string(index);
+            for (auto const& uri : uris)
+                item.tokens.push_back(url_encode(cloudy::sign_storage_order(pv_key,
+                                                                            uri,
+                                                                            session_id,
+                                                                            duration + 3600)));
+        }
+
+        vector<statistics> results(concurrency);
+        std::atomic<uint64_t> next_index(0);
+
+        auto start = chrono::steady_clock::now();
+        auto end = start + chrono::seconds(duration);
+
+        auto run = [&](size_t viewer_index)
+        {
+            viewer& player = viewers[viewer_index];
+            statistics& result = results[viewer_index];
+            connection client(host, port);
+
+            while (true)
+            {
+                auto scheduled = chrono::steady_clock::now();
+                if (rate > 0)
+                {
+                    //  the latency counts from the time the request was due, so that
+                    //  a slow server doesn't hide the requests it delayed
+                    uint64_t index = next_index++;
+                    scheduled = start + chrono::duration_cast<chrono::steady_clock::duration>(
+                                            chrono::duration<double>(double(index) / rate));
+                    if (scheduled >= end)
+                        break;
+                    std::this_thread::sleep_until(scheduled);
+                }
+                else if (scheduled >= end)
+                    break;
+
+                response item;
+                bool sent = client.request(player.next_request(address), item);
+                auto latency = chrono::steady_clock::now() - scheduled;
+
+                ++result.requests;
+                if (false == sent)
+                {
+                    ++result.connection_errors;
+                    //  not to spin on a server that is down
+                    std::this_thread::sleep_for(chrono::milliseconds(10));
+                    continue;
+                }
+
+                ++result.statuses[item.status];
+                result.bytes += item.bytes;
+                if (item.status < 200 || item.status >= 300)
+                    ++result.http_errors;
+                else
+                    result.latencies.push_back(uint64_t(chrono::duration_cast<chrono::microseconds>(latency).count()));
+
+                player.advance(item);
+            }
+        };
+
+        vector<std::thread> threads;
+        for (size_t index = 0; index != concurrency; ++index)
+            threads.push_back(std::thread(run, index));
+        for (auto& thread : threads)
+            thread.join();
+
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        statistics total;
+        for (auto const& item : results)
+            total.merge(item);
+        std::sort(total.latencies.begin(), total.latencies.end());
+
+        uint64_t errors = total.connection_errors + total.http_errors;
+        double mean = 0;
+        for (auto value : total.latencies)
+            mean += double(value) / 1000;
+        if (false == total.latencies.empty())
+            mean /= double(total.latencies.size());
+
+        string json = "{\"pattern\":\"" + pattern + "\"";
+        json += ",\"concurrency\":" + std::to_string(concurrency);
+        json += ",\"rate\":" + json_number(rate);
+        json += ",\"seconds\":" + json_number(seconds);
+        json += ",\"requests\":" + std::to_string(total.requests);
+        json += ",\"requests_per_second\":" + json_number(double(total.requests) / seconds);
+        json += ",\"bytes_per_second\":" + json_number(double(total.bytes) / seconds);
+        json += ",\"errors\":" + std::to_string(errors);
+        json += ",\"connection_errors\":" + std::to_string(total.connection_errors);
+        json += ",\"http_errors\":" + std::to_string(total.http_errors);
+        json += ",\"error_rate\":" + json_number(total.requests ? double(errors) / double(total.requests) : 0);
+        json += ",\"latency_ms\":{\"mean\":" + json_number(mean);
+        json += ",\"p50\":" + json_number(percentile(total.latencies, 0.5));
+        json += ",\"p90\":" + json_number(percentile(total.latencies, 0.9));
+        json += ",\"p99\":" + json_number(percentile(total.latencies, 0.99));
+        json += ",\"p999\":" + json_number(percentile(total.latencies, 0.999));
+        json += ",\"max\":" + json_number(percentile(total.latencies, 1));
+        json += "},\"statuses\":{";
+        for (auto it = total.statuses.begin(); it != total.statuses.end(); ++it)
+        {
+            if (it != total.statuses.begin())
+                json += ",";
+            json += "\"" + std::to_string(it->first) + "\":" + std::to_string(it->second);
+        }
+        json += "}}\n";
+
+        std::cerr << total.requests << " requests in " << seconds << "s, " <<
+                     errors << " errors, p99 " << percentile(total.latencies, 0.99) << "ms" << endl;
+
+        if (output.empty())
+            cout << json;
+        else
+        {
+            std::ofstream file(output);
+            file << json;
+            if (false == file.good())
+                throw std::runtime_error("cannot write " + output);
+        }
+    }
+    catch (std::exception const& ex)
+    {
+        cout << "exception cought: " << ex.what() << endl;
+        return 1;
+    }
+    catch (...)
+    {
+        cout << "always throw std::exceptions" << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+namespace
+{
+bool process_command_line(int argc, char** argv,
+                          string& address,
+                          meshpp::private_key& pv_key,
+                          vector<string>& uris,
+                          string& uris_file,
+                          string& pattern,
+                          uint64_t& range_size,
+                          size_t& concurrency,
+                          double& rate,
+                          uint64_t& duration,
+                          string& output)
+{
+    string str_pv_key;
+
+    program_options::options_description options_description;
+    try
+    {
+        auto desc_init = options_description.add_options()
+            ("help,h", "print this help message and exit.")
+            ("address,a", program_options::value<string>(&address)->required(),
+                            "the storage interface of cloudyd, as 127.0.0.1:4445")
+            ("daemon-private-key,k", program_options::value<string>(&str_pv_key)->required(),
+                            "the daemon private key of cloudyd, to sign the authorization")
+            ("uris,u", program_options::value<vector<string>>(&uris)->multitoken(),
+                            "the storage uris to fetch")
+            ("uris-file", program_options::value<string>(&uris_file),
+                            "a file with the storage uris to fetch, one per line")
+            ("pattern,p", program_options::value<string>(&pattern),
+                            "segment, range or mixed")
+            ("range-size", program_options::value<uint64_t>(&range_size),
+                            "the bytes a range request asks for")
+            ("concurrency,c", program_options::value<size_t>(&concurrency),
+                            "how many viewers fetch at the same time, each on its own connection")
+            ("rate,r", program_options::value<double>(&rate),
+                            "requests per second of all the viewers, 0 for as fast as they can")
+            ("duration,d", program_options::value<uint64_t>(&duration),
+                            "how long to run, in seconds")
+            ("output,o", program_options::value<string>(&output),
+                            "the json file to write the results to, stdout by default");
+        (void)(desc_init);
+
+        program_options::variables_map options;
+
+        program_options::store(
+                    program_options::parse_command_line(argc, argv, options_description),
+                    options);
+
+        if (options.count("help"))
+        {
+            throw std::runtime_error("");
+        }
+
+        program_options::notify(options);
+
+        pv_key = meshpp::private_key(str_pv_key);
+
+        if (pattern != "segment" &&
+            pattern != "range" &&
+            pattern != "mixed")
+            throw std::runtime_error("pattern must be segment, range or mixed");
+        if (0 == range_size)
+            throw std::runtime_error("range-size must be positive");
+        if (0 == concurrency)
+            throw std::runtime_error("concurrency must be positive");
+        if (rate < 0)
+            throw std::runtime_error("rate must not be negative");
+        if (0 == duration)
+            throw std::runtime_error("duration must be positive");
+    }
+    catch (std::exception const& ex)
+    {
+        std::stringstream ss;
+        ss << options_description;
+
+        string ex_message = ex.what();
+        if (false == ex_message.empty())
+            cout << ex.what() << endl << endl;
+        cout << ss.str();
+        return false;
+    }
+    catch (...)
+    {
+        cout << "always throw std::exceptions" << endl;
+        return false;
+    }
+
+    return true;
+}
+}
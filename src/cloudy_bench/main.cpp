@@ -0,0 +1,795 @@
+#include "common.hpp"
+#include "storage.hpp"
+#include "hash.hpp"
+#include "library.hpp"
+#include "admin_server.hpp"
+#include "spsc_ring.hpp"
+#include "storage_http.hpp"
+#include "admin_model.hpp"
+#include "storage_model.hpp"
+#include "internal_model.hpp"
+
+#include "runner.hpp"
+
+#include <belt.pp/packet.hpp>
+#include <belt.pp/parser.hpp>
+#include <belt.pp/processor.hpp>
+#include <belt.pp/direct_stream.hpp>
+
+#include <mesh.pp/cryptoutility.hpp>
+#include <mesh.pp/fileutility.hpp>
+#include <mesh.pp/settings.hpp>
+
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <exception>
+#include <utility>
+#include <cstdio>
+
+namespace program_options = boost::program_options;
+namespace filesystem = boost::filesystem;
+namespace chrono = std::chrono;
+
+using std::string;
+using std::vector;
+using std::pair;
+using std::cout;
+using std::endl;
+using beltpp::packet;
+using cloudy_bench::measurement;
+using cloudy_bench::stopwatch;
+using cloudy_bench::runner;
+using cloudy_bench::url_encode;
+using cloudy_bench::peak_rss_reset;
+using cloudy_bench::peak_rss;
+
+namespace
+{
+//  the same content on every run, so that the results compare between commits
+string random_data(std::mt19937_64& generator, size_t size)
+{
+    string result;
+    result.resize(size);
+    for (auto& ch : result)
+        ch = char(generator());
+
+    return result;
+}
+
+void write_file(filesystem::path const& path, string const& data)
+{
+    std::ofstream file(path.string(), std::ios::binary);
+    file.write(data.data(), std::streamsize(data.size()));
+    if (false == file.good())
+        throw std::runtime_error("write_file: " + path.string());
+}
+
+//  written in blocks, the large files don't fit in memory
+void write_random_file(filesystem::path const& path, std::mt19937_64& generator, uint64_t size)
+{
+    std::ofstream file(path.string(), std::ios::binary);
+    for (uint64_t offset = 0; offset < size; offset += cloudy::stream_hash_block_size)
+    {
+        string block = random_data(generator, std::min(uint64_t(cloudy::stream_hash_block_size), size - offset));
+        file.write(block.data(), std::streamsize(block.size()));
+    }
+    if (false == file.good())
+        throw std::runtime_error("write_random_file: " + path.string());
+}
+
+string label(uint64_t size)
+{
+    if (size >= 1024 * 1024 && size % (1024 * 1024) == 0)
+        return std::to_string(size / 1024 / 1024) + "MiB";
+    if (size >= 1024 && size % 1024 == 0)
+        return std::to_string(size / 1024) + "KiB";
+    return std::to_string(size) + "B";
+}
+
+//  as storage server answers a range request
+StorageModel::StorageFileRange read_range(cloudy::storage& storage,
+                                          string const& uri,
+                                          uint64_t start,
+                                          uint64_t count)
+{
+    StorageModel::StorageFile file;
+    if (false == storage.get(uri, file))
+        throw std::runtime_error("read_range: missing " + uri);
+
+    count = std::min(count, file.data.length() - start);
+
+    StorageModel::StorageFileRange result;
+    result.start = start;
+    result.count = count;
+    result.full_size = file.data.length();
+    result.data = file.data.substr(start, count);
+    result.mime_type = file.mime_type;
+
+    return result;
+}
+
+InternalModel::ProcessMediaCheckResult library_item(uint64_t index)
+{
+    AdminModel::MediaTypeDescriptionRaw raw;
+    raw.mime_type = "application/octet-stream";
+
+    InternalModel::ProcessMediaCheckResult result;
+    result.path = {"bench", "d" + std::to_string(index / 1000), "f" + std::to_string(index)};
+    result.type_description = AdminModel::MediaTypeDescriptionVariant(packet(std::move(raw)));
+    result.accumulated = 0;
+    result.count = 1;
+    result.result_type = InternalModel::ResultType::file;
+
+    return result;
+}
+
+string library_hash(uint64_t index)
+{
+    return meshpp::hash(std::to_string(index));
+}
+
+void fill_library(cloudy::library& library, uint64_t count, uint64_t batch)
+{
+    for (uint64_t index = 0; index != count; ++index)
+    {
+        library.add(library_item(index), library_hash(index) + "uri", library_hash(index));
+
+        if ((index + 1) % batch == 0 || index + 1 == count)
+        {
+            library.save();
+            library.commit();
+        }
+    }
+}
+
+bool process_command_line(int argc, char** argv,
+                          string& output,
+                          string& directory,
+                          size_t& repeat,
+                          string& filter,
+                          vector<uint64_t>& library_sizes,
+                          uint64_t& large_size);
+}
+
+int main(int argc, char** argv)
+{
+    meshpp::config::set_public_key_prefix("Cloudy-");
+
+    string output;
+    string directory;
+    size_t repeat = 3;
+    string filter;
+    vector<uint64_t> library_sizes = {10000, 100000, 1000000};
+    uint64_t large_size = 16 * 1024 * 1024;
+
+    if (false == process_command_line(argc, argv,
+                                      output,
+                                      directory,
+                                      repeat,
+                                      filter,
+                                      library_sizes,
+                                      large_size))
+        return 1;
+
+    try
+    {
+        filesystem::path bench_directory(directory);
+        if (bench_directory.empty())
+            bench_directory = filesystem::temp_directory_path() / filesystem::unique_path("cloudy_bench_%%%%%%%%");
+
+        runner bench(bench_directory, repeat, filter);
+
+        uint64_t const small_size = 1024;
+        uint64_t const small_count = 1000;
+        uint64_t const large_count = 8;
+
+        ///
+        //  storage
+        ///
+        bench.run("storage_put_" + label(small_size), [=](filesystem::path const& path)
+        {
+            std::mt19937_64 generator(0);
+            vector<string> blobs;
+            for (uint64_t index = 0; index != small_count; ++index)
+                blobs.push_back(random_data(generator, small_size));
+
+            filesystem::create_directories(path / "bin");
+            cloudy::storage storage(path, path / "bin");
+
+            measurement result;
+            result.operations = small_count;
+
+            stopwatch timer;
+            for (auto& blob : blobs)
+            {
+                StorageModel::StorageFile file;
+                file.mime_type = "application/octet-stream";
+                file.data = std::move(blob);
+
+                string uri;
+                storage.put(std::move(file), uri);
+            }
+            result.seconds = timer.seconds();
+
+            return result;
+        });
+
+        //  the large files are hashed as they are read, the result must be what
+        //  meshpp::hash gives for the same data in memory
+        bench.run("stream_hash_" + label(large_size), [=](filesystem::path const&)
+        {
+            std::mt19937_64 generator(0);
+
+            //  the digests of "286" and of "88484" start with one and two zero bytes
+            vector<string> inputs = {string(), "0", "286", "88484", random_data(generator, 1000)};
+            for (auto const& input : inputs)
+            {
+                cloudy::stream_hash hash;
+                hash.update(input.data(), input.size() / 3);
+                hash.update(input.data() + input.size() / 3, input.size() - input.size() / 3);
+                if (hash.result() != meshpp::hash(input))
+                    throw std::runtime_error("stream_hash: hash.result() != meshpp::hash(input), " + input.substr(0, 16));
+            }
+
+            string data = random_data(generator, large_size);
+
+            measurement result;
+            result.operations = 1;
+            result.extra.push_back(std::make_pair(string("bytes"), double(large_size)));
+
+            stopwatch timer;
+            cloudy::stream_hash hash;
+            for (size_t offset = 0; offset < data.size(); offset += cloudy::stream_hash_block_size)
+                hash.update(data.data() + offset, std::min(cloudy::stream_hash_block_size, data.size() - offset));
+            string stream_result = hash.result();
+            result.seconds = timer.seconds();
+
+            if (stream_result != meshpp::hash(data))
+                throw std::runtime_error("stream_hash: stream_result != meshpp::hash(data)");
+
+            return result;
+        });
+
+        for (auto size_count : {std::make_pair(small_size, small_count),
+                                std::make_pair(large_size, large_count)})
+        bench.run("storage_put_file_" + label(size_count.first), [=](filesystem::path const& path)
+        {
+            std::mt19937_64 generator(0);
+            filesystem::create_directories(path / "bin");
+            filesystem::create_directories(path / "input");
+
+            vector<filesystem::path> inputs;
+            for (uint64_t index = 0; index != size_count.second; ++index)
+            {
+                inputs.push_back(path / "input" / std::to_string(index));
+                write_file(inputs.back(), random_data(generator, size_count.first));
+            }
+
+            cloudy::storage storage(path, path / "bin");
+
+            measurement result;
+            result.operations = size_count.second;
+            result.extra.push_back(std::make_pair(string("bytes"), double(size_count.first)));
+
+            stopwatch timer;
+            for (auto const& input : inputs)
+            {
+                StorageModel::StorageFile file;
+                file.mime_type = "application/octet-stream";
+                file.data = input.string();
+
+                string uri;
+                storage.put_file(std::move(file), string(), uri);
+            }
+            result.seconds = timer.seconds();
+
+            return result;
+        });
+
+        //  the large files are moved into storage and hashed in blocks, so the peak
+        //  memory must not grow with the file size
+        uint64_t const huge_size = large_size * 32;
+        bench.run("storage_put_file_rss_" + label(huge_size), [=](filesystem::path const& path)
+        {
+            std::mt19937_64 generator(0);
+            filesystem::create_directories(path / "bin");
+            filesystem::create_directories(path / "input");
+
+            cloudy::storage storage(path, path / "bin");
+
+            measurement result;
+            result.operations = 2;
+            result.extra.push_back(std::make_pair(string("bytes"), double(huge_size)));
+
+            vector<double> growths;
+            for (uint64_t size : {large_size, huge_size})
+            {
+                filesystem::path input = path / "input" / label(size);
+                write_random_file(input, generator, size);
+
+                StorageModel::StorageFile file;
+                file.mime_type = "application/octet-stream";
+                file.data = input.string();
+
+                peak_rss_reset();
+                double before = peak_rss();
+
+                stopwatch timer;
+                string uri;
+                storage.put_file(std::move(file), string(), uri);
+                result.seconds += timer.seconds();
+
+                growths.push_back(peak_rss() - before);
+            }
+
+            result.extra.push_back(std::make_pair(string("peak_rss_growth_" + label(large_size)), growths.front()));
+            result.extra.push_back(std::make_pair(string("peak_rss_growth_" + label(huge_size)), growths.back()));
+
+            //  a few blocks of slack, for the allocator and the map of the storage
+            if (growths.back() > growths.front() + 4 * cloudy::stream_hash_block_size)
+                throw std::runtime_error("storage_put_file_rss: the peak memory grows with the file size");
+
+            return result;
+        });
+
+        //  the small files are in the storage map, the large ones are files of their own
+        for (auto size_count : {std::make_pair(small_size, small_count),
+                                std::make_pair(large_size, large_count)})
+        for (bool range : {false, true})
+        bench.run(string(range ? "storage_get_range_" : "storage_get_") + label(size_count.first),
+                  [=](filesystem::path const& path)
+        {
+            std::mt19937_64 generator(0);
+            filesystem::create_directories(path / "bin");
+            filesystem::create_directories(path / "input");
+
+            cloudy::storage storage(path, path / "bin");
+
+            vector<string> uris;
+            for (uint64_t index = 0; index != size_count.second; ++index)
+            {
+                filesystem::path input = path / "input" / std::to_string(index);
+                write_file(input, random_data(generator, size_count.first));
+
+                StorageModel::StorageFile file;
+                file.mime_type = "application/octet-stream";
+                file.data = input.string();
+
+                string uri;
+                storage.put_file(std::move(file), string(), uri);
+                uris.push_back(uri);
+            }
+
+            //  a player asks for a megabyte at a time
+            uint64_t range_count = std::min(size_count.first / 4, uint64_t(1024 * 1024));
+            uint64_t rounds = (size_count.first < cloudy::storage_inline_size_limit) ? 10 : 2;
+
+            measurement result;
+            result.operations = rounds * uris.size();
+
+            uint64_t bytes = 0;
+            stopwatch timer;
+            for (uint64_t round = 0; round != rounds; ++round)
+            for (auto const& uri : uris)
+            {
+                if (range)
+                    bytes += read_range(storage, uri, size_count.first / 2, range_count).data.size();
+                else
+                {
+                    StorageModel::StorageFile file;
+                    storage.get(uri, file);
+                    bytes += file.data.size();
+                }
+            }
+            result.seconds = timer.seconds();
+            result.extra.push_back(std::make_pair(string("bytes"), double(bytes) / double(result.operations)));
+
+            return result;
+        });
+
+        ///
+        //  library
+        ///
+        for (uint64_t size : library_sizes)
+        {
+            bench.run("library_add_" + std::to_string(size), [=](filesystem::path const& path)
+            {
+                cloudy::library library(path, 1);
+
+                measurement result;
+                result.operations = size;
+
+                stopwatch timer;
+                fill_library(library, size, 1000);
+                result.seconds = timer.seconds();
+
+                return result;
+            });
+
+            bench.run("library_list_index_" + std::to_string(size), [=](filesystem::path const& path)
+            {
+                {
+                    cloudy::library library(path, 1);
+                    fill_library(library, size, 1000);
+                }
+                //  a fresh instance, nothing is cached yet
+                cloudy::library library(path, 1);
+
+                std::mt19937_64 generator(0);
+                uint64_t const lookups = 10000;
+
+                measurement result;
+                result.operations = lookups;
+
+                stopwatch timer;
+                for (uint64_t index = 0; index != lookups; ++index)
+                {
+                    auto response = library.list_index(library_hash(generator() % size));
+                    if (response.list_index.size() != 1)
+                        throw std::runtime_error("library_list_index: response.list_index.size() != 1");
+                }
+                result.seconds = timer.seconds();
+
+                stopwatch timer_all;
+                auto response = library.list_index(string());
+                result.extra.push_back(std::make_pair(string("list_all_seconds"), timer_all.seconds()));
+                if (response.list_index.size() != size)
+                    throw std::runtime_error("library_list_index: response.list_index.size() != size");
+
+                return result;
+            });
+        }
+
+        //  the worker reports of changed files, pushed in bursts through the ring and
+        //  processed by admin run, which saves and commits every packet
+        for (uint64_t burst : {uint64_t(1), uint64_t(64)})
+        bench.run("admin_burst_" + std::to_string(burst), [=](filesystem::path const& path)
+        {
+            uint64_t const packets = 2000;
+
+            filesystem::create_directories(path / "admin");
+            filesystem::create_directories(path / "library");
+
+            AdminModel::MediaTypeDescriptionRaw raw;
+            raw.mime_type = "application/octet-stream";
+
+            AdminModel::WatchItem watch_item;
+            watch_item.path = {"bench"};
+            watch_item.type_descriptions.push_back(AdminModel::MediaTypeDescriptionVariant(packet(std::move(raw))));
+
+            AdminModel::WatchList watch;
+            watch.items.push_back(std::move(watch_item));
+            write_file(path / "admin" / "watch.json", watch.to_string());
+
+            beltpp::ip_address address;
+            //  nothing connects, any free port does
+            address.from_string("127.0.0.1:0");
+
+            meshpp::random_seed admin_seed;
+            beltpp::direct_channel channel;
+            cloudy::spsc_ring<packet> worker_results;
+
+            cloudy::admin_server admin(address,
+                                       path / "library",
+                                       path / "admin",
+                                       admin_seed.get_private_key(0),
+                                       nullptr,
+                                       channel,
+                                       worker_results,
+                                       1,
+                                       packets,
+                                       chrono::steady_clock::duration::zero(),
+                                       burst);
+
+            //  the requests admin sends to worker are left unanswered
+            beltpp::event_handler_ptr ptr_worker_eh = beltpp::libprocessor::construct_event_handler();
+            beltpp::stream_ptr ptr_worker_stream = beltpp::construct_direct_stream(cloudy::worker_peerid,
+                                                                                   *ptr_worker_eh,
+                                                                                   channel);
+
+            bool stop = false;
+
+            measurement result;
+            result.operations = packets;
+
+            stopwatch timer;
+            for (uint64_t index = 0; index != packets; index += burst)
+            {
+                for (uint64_t item = index; item != std::min(index + burst, packets); ++item)
+                {
+                    InternalModel::WatchChanges changes;
+                    changes.paths.push_back({"bench", "d" + std::to_string(item / 1000), "f" + std::to_string(item)});
+
+                    if (false == worker_results.push(packet(std::move(changes))))
+                        throw std::runtime_error("admin_burst: worker_results.push");
+                }
+
+                //  a single run takes all the ring has
+                admin.run(stop);
+            }
+            result.seconds = timer.seconds();
+
+            return result;
+        });
+
+        ///
+        //  worker to admin ring
+        ///
+        bench.run("spsc_ring_worker_results", [](filesystem::path const&)
+        {
+            uint64_t const messages = 1000000;
+
+            cloudy::spsc_ring<packet> ring(1024);
+
+            std::mutex mutex;
+            std::condition_variable consumer_condition;
+            std::condition_variable producer_condition;
+            bool consumer_woken = false;
+            bool producer_woken = false;
+
+            //  as the event handler wake of admin and of worker
+            ring.set_consumer_wake([&]
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                consumer_woken = true;
+                consumer_condition.notify_one();
+            });
+            ring.set_producer_wake([&]
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                producer_woken = true;
+                producer_condition.notify_one();
+            });
+
+            measurement result;
+            result.operations = messages;
+
+            stopwatch timer;
+
+            std::thread producer([&]
+            {
+                for (uint64_t index = 0; index != messages; ++index)
+                {
+                    InternalModel::StorageCredit credit;
+                    credit.count = index;
+                    packet item(std::move(credit));
+
+                    while (false == ring.push(std::move(item)))
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        producer_condition.wait(lock, [&]{ return producer_woken; });
+                        producer_woken = false;
+                    }
+                }
+            });
+
+            vector<packet> items;
+            uint64_t received = 0;
+            while (received != messages)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    consumer_condition.wait(lock, [&]{ return consumer_woken; });
+                    consumer_woken = false;
+                }
+
+                received += ring.pop_all(items);
+                items.clear();
+            }
+
+            producer.join();
+            result.seconds = timer.seconds();
+            result.extra.push_back(std::make_pair(string("wakes_per_message"),
+                                                  double(ring.wake_count()) / double(ring.pushed_count())));
+
+            return result;
+        });
+
+        ///
+        //  storage http
+        ///
+        meshpp::random_seed seed;
+        meshpp::private_key pv_key = seed.get_private_key(0);
+        string storage_order = cloudy::sign_storage_order(pv_key, library_hash(0), string(), 3600);
+
+        bench.run("verify_storage_order", [&](filesystem::path const&)
+        {
+            uint64_t const verifications = 10000;
+
+            measurement result;
+            result.operations = verifications;
+
+            stopwatch timer;
+            for (uint64_t index = 0; index != verifications; ++index)
+            {
+                string channel_address, file_uri, session_id;
+                uint64_t seconds;
+                chrono::system_clock::time_point tp;
+
+                if (false == cloudy::verify_storage_order(storage_order,
+                                                          channel_address,
+                                                          file_uri,
+                                                          session_id,
+                                                          seconds,
+                                                          tp))
+                    throw std::runtime_error("verify_storage_order: false");
+            }
+            result.seconds = timer.seconds();
+
+            return result;
+        });
+
+        for (bool range : {false, true})
+        bench.run(range ? "http_message_list_load_range" : "http_message_list_load", [&](filesystem::path const&)
+        {
+            uint64_t const requests = 100000;
+
+            string request = "GET /storage?file=" + library_hash(0) +
+                             "&authorization=" + url_encode(storage_order) + " HTTP/1.1\r\n"
+                             "Host: 127.0.0.1:4445\r\n"
+                             "User-Agent: cloudy_bench\r\n"
+                             "Accept: */*\r\n";
+            if (range)
+                request += "Range: bytes=1048576-2097151\r\n";
+            request += "\r\n";
+
+            auto putl = cloudy::get_storage_putl();
+
+            measurement result;
+            result.operations = requests;
+
+            stopwatch timer;
+            for (uint64_t index = 0; index != requests; ++index)
+            {
+                beltpp::detail::session_special_data ssd;
+                string::const_iterator begin = request.cbegin();
+                string::const_iterator const end = request.cend();
+
+                auto parsed = cloudy::http::message_list_load<&StorageModel::message_list_load>(begin, end, ssd, putl.get());
+                if (nullptr == parsed.pmsg)
+                    throw std::runtime_error("http_message_list_load: nullptr == parsed.pmsg");
+            }
+            result.seconds = timer.seconds();
+
+            return result;
+        });
+
+        for (uint64_t size : {small_size, large_size})
+        bench.run("http_file_response_" + label(size), [=](filesystem::path const&)
+        {
+            std::mt19937_64 generator(0);
+            uint64_t const responses = (size < cloudy::storage_inline_size_limit) ? 100000 : 16;
+
+            StorageModel::StorageFile file;
+            file.mime_type = "video/mp4";
+            file.data = random_data(generator, size);
+            packet response_packet(std::move(file));
+
+            measurement result;
+            result.operations = responses;
+
+            uint64_t bytes = 0;
+            stopwatch timer;
+            for (uint64_t index = 0; index != responses; ++index)
+            {
+                beltpp::detail::session_special_data ssd;
+                bytes += cloudy::http::file_response(ssd, response_packet).size();
+            }
+            result.seconds = timer.seconds();
+            result.extra.push_back(std::make_pair(string("bytes"), double(bytes) / double(responses)));
+
+            return result;
+        });
+
+        filesystem::remove_all(bench_directory);
+
+        string json = bench.json();
+        if (output.empty())
+            cout << json;
+        else
+        {
+            std::ofstream file(output);
+            file << json;
+            if (false == file.good())
+                throw std::runtime_error("cannot write " + output);
+        }
+    }
+    catch (std::exception const& ex)
+    {
+        cout << "exception cought: " << ex.what() << endl;
+        return 1;
+    }
+    catch (...)
+    {
+        cout << "always throw std::exceptions" << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+namespace
+{
+bool process_command_line(int argc, char** argv,
+                          string& output,
+                          string& directory,
+                          size_t& repeat,
+                          string& filter,
+                          vector<uint64_t>& library_sizes,
+                          uint64_t& large_size)
+{
+    program_options::options_description options_description;
+    try
+    {
+        auto desc_init = options_description.add_options()
+            ("help,h", "print this help message and exit.")
+            ("output,o", program_options::value<string>(&output),
+                            "the json file to write the results to, stdout by default")
+            ("directory,d", program_options::value<string>(&directory),
+                            "where the benchmarks keep their data, a temporary directory by default")
+            ("repeat,r", program_options::value<size_t>(&repeat),
+                            "how many times to run each benchmark, the median is reported")
+            ("filter,f", program_options::value<string>(&filter),
+                            "run only the benchmarks with this in the name")
+            ("library-sizes", program_options::value<vector<uint64_t>>(&library_sizes)->multitoken(),
+                            "the library entry counts to benchmark")
+            ("large-size", program_options::value<uint64_t>(&large_size),
+                            "the size of the large files, in bytes");
+        (void)(desc_init);
+
+        program_options::variables_map options;
+
+        program_options::store(
+                    program_options::parse_command_line(argc, argv, options_description),
+                    options);
+
+        program_options::notify(options);
+
+        if (options.count("help"))
+        {
+            throw std::runtime_error("");
+        }
+
+        if (0 == repeat)
+            throw std::runtime_error("repeat must be positive");
+        if (large_size < cloudy::storage_inline_size_limit)
+            throw std::runtime_error("large-size must not be less than the storage inline size limit");
+        for (auto size : library_sizes)
+        {
+            if (0 == size)
+                throw std::runtime_error("library-sizes must be positive");
+        }
+    }
+    catch (std::exception const& ex)
+    {
+        std::stringstream ss;
+        ss << options_description;
+
+        string ex_message = ex.what();
+        if (false == ex_message.empty())
+            cout << ex.what() << endl << endl;
+        cout << ss.str();
+        return false;
+    }
+    catch (...)
+    {
+        cout << "always throw std::exceptions" << endl;
+        return false;
+    }
+
+    return true;
+}
+}
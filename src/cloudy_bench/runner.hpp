@@ -0,0 +1,181 @@
+#pragma once
+
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <utility>
+#include <cstdio>
+#include <cctype>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace cloudy_bench
+{
+inline std::string json_number(double value)
+{
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+    return buffer;
+}
+
+inline std::string url_encode(std::string const& value)
+{
+    std::string result;
+    for (char ch : value)
+    {
+        if (std::isalnum(static_cast<unsigned char>(ch)) ||
+            ch == '-' || ch == '_' || ch == '.' || ch == '~')
+            result += ch;
+        else
+        {
+            char buffer[4];
+            std::snprintf(buffer, sizeof(buffer), "%%%02X", unsigned(static_cast<unsigned char>(ch)));
+            result += buffer;
+        }
+    }
+
+    return result;
+}
+
+//  resets the peak resident set size, so that every run reports its own.
+//  linux only, elsewhere the peak is of the whole run so far
+inline void peak_rss_reset()
+{
+#ifdef __linux__
+    std::ofstream file("/proc/self/clear_refs");
+    file << "5";
+#endif
+}
+
+inline double peak_rss()
+{
+#ifdef __linux__
+    std::ifstream file("/proc/self/status");
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (0 == line.find("VmHWM:"))
+            return double(std::stoull(line.substr(6))) * 1024;
+    }
+#endif
+#ifndef _WIN32
+    rusage usage;
+    if (0 != getrusage(RUSAGE_SELF, &usage))
+        return 0;
+#ifdef __APPLE__
+    //  in bytes on macos, in kilobytes elsewhere
+    return double(usage.ru_maxrss);
+#else
+    return double(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+//  what a single run of a benchmark reports, the extra values are written to the json as they are
+class measurement
+{
+public:
+    std::string name;
+    uint64_t operations = 0;
+    double seconds = 0;
+    std::vector<std::pair<std::string, double>> extra;
+};
+
+class stopwatch
+{
+public:
+    stopwatch()
+        : start(std::chrono::steady_clock::now())
+    {}
+
+    double seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+class runner
+{
+public:
+    runner(boost::filesystem::path const& _directory,
+           size_t _repeat,
+           std::string const& _filter)
+        : directory(_directory)
+        , repeat(_repeat)
+        , filter(_filter)
+    {}
+
+    //  every repetition starts in an empty directory, the median is reported
+    void run(std::string const& name, std::function<measurement(boost::filesystem::path const&)> const& once)
+    {
+        if (false == filter.empty() &&
+            std::string::npos == name.find(filter))
+            return;
+
+        std::vector<measurement> repetitions;
+        for (size_t index = 0; index != repeat; ++index)
+        {
+            boost::filesystem::path path = directory / name;
+            boost::filesystem::remove_all(path);
+            boost::filesystem::create_directories(path);
+
+            repetitions.push_back(once(path));
+            repetitions.back().name = name;
+
+            boost::filesystem::remove_all(path);
+        }
+
+        std::sort(repetitions.begin(), repetitions.end(), [](measurement const& first, measurement const& second)
+        {
+            return first.seconds < second.seconds;
+        });
+
+        auto const& median = repetitions[repetitions.size() / 2];
+        std::cerr << name << ": " << median.operations << " in " << median.seconds << "s" << std::endl;
+
+        results.push_back(median);
+    }
+
+    std::string json() const
+    {
+        std::string result = "{\"benchmarks\":[";
+        for (size_t index = 0; index != results.size(); ++index)
+        {
+            auto const& item = results[index];
+
+            if (index)
+                result += ",";
+            result += "\n{\"name\":\"" + item.name + "\"";
+            result += ",\"operations\":" + std::to_string(item.operations);
+            result += ",\"seconds\":" + json_number(item.seconds);
+            if (item.seconds > 0)
+                result += ",\"operations_per_second\":" + json_number(double(item.operations) / item.seconds);
+            if (item.operations)
+                result += ",\"nanoseconds_per_operation\":" + json_number(item.seconds * 1e9 / double(item.operations));
+            for (auto const& extra_item : item.extra)
+                result += ",\"" + extra_item.first + "\":" + json_number(extra_item.second);
+            result += "}";
+        }
+        result += "\n],\"repeat\":" + std::to_string(repeat) + "}\n";
+
+        return result;
+    }
+private:
+    boost::filesystem::path directory;
+    size_t repeat;
+    std::string filter;
+    std::vector<measurement> results;
+};
+}
@@ -0,0 +1,403 @@
+#include "test_source.hpp"
+
+#include <belt.pp/scope_helper.hpp>
+
+#include <boost/filesystem/operations.hpp>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/display.h>
+#include <libavutil/opt.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+}
+
+#include <memory>
+#include <vector>
+
+namespace filesystem = boost::filesystem;
+using std::string;
+using std::vector;
+
+namespace cloudy_bench
+{
+namespace
+{
+//  same as the ones in libavwrapper, which are not exported
+template <typename T>
+using av_ptr = std::unique_ptr<T, void(*)(T*)>;
+
+using packet_ptr = av_ptr<AVPacket>;
+packet_ptr packet_alloc()
+{
+    return packet_ptr(av_packet_alloc(), [](AVPacket* p)
+    {
+        if (nullptr != p)
+            av_packet_free(&p);
+    });
+}
+void packet_unref(packet_ptr& ptr)
+{
+    av_packet_unref(ptr.get());
+}
+
+using frame_ptr = av_ptr<AVFrame>;
+frame_ptr frame_alloc()
+{
+    return frame_ptr(av_frame_alloc(), [](AVFrame* p)
+    {
+        if (nullptr != p)
+            av_frame_free(&p);
+    });
+}
+void frame_unref(frame_ptr& ptr)
+{
+    if (ptr)
+        av_frame_unref(ptr.get());
+}
+
+using filter_graph_ptr = av_ptr<AVFilterGraph>;
+filter_graph_ptr filter_graph_null()
+{
+    return filter_graph_ptr(nullptr, [](AVFilterGraph* p)
+    {
+        if (nullptr != p)
+            avfilter_graph_free(&p);
+    });
+}
+filter_graph_ptr filter_graph_alloc()
+{
+    auto res = filter_graph_null();
+    res.reset(avfilter_graph_alloc());
+    return res;
+}
+
+using codec_ptr = av_ptr<AVCodec>;
+codec_ptr codec_null()
+{
+    //  the codecs are static, nothing to free
+    return codec_ptr(nullptr, [](AVCodec*){});
+}
+codec_ptr codec_find_encoder(string const& name)
+{
+    auto res = codec_null();
+    res.reset(const_cast<AVCodec*>(avcodec_find_encoder_by_name(name.c_str())));
+    return res;
+}
+
+using codec_context_ptr = av_ptr<AVCodecContext>;
+codec_context_ptr codec_context_null()
+{
+    return codec_context_ptr(nullptr, [](AVCodecContext* p)
+    {
+        if (nullptr != p)
+            avcodec_free_context(&p);
+    });
+}
+codec_context_ptr codec_context_alloc(codec_ptr& avcodec)
+{
+    auto res = codec_context_null();
+    res.reset(avcodec_alloc_context3(avcodec.get()));
+    return res;
+}
+
+using format_context_ptr = av_ptr<AVFormatContext>;
+format_context_ptr format_context_alloc_output(string const& filepath)
+{
+    AVFormatContext* p = nullptr;
+    avformat_alloc_output_context2(&p,
+                                   nullptr,
+                                   nullptr,
+                                   filepath.c_str());
+
+    return format_context_ptr(p, [](AVFormatContext* p)
+    {
+        if (nullptr != p)
+            avformat_free_context(p);
+    });
+}
+
+class TestSourceStream
+{
+public:
+    codec_ptr avcodec = codec_null();
+    codec_context_ptr avcodec_context = codec_context_null();
+    AVStream* avstream = nullptr;
+    filter_graph_ptr filter_graph = filter_graph_null();
+    AVFilterContext* filter_context_sink = nullptr;
+    frame_ptr frame = frame_alloc();
+    packet_ptr packet = packet_alloc();
+    //  the timestamp of the last generated frame, in the codec time base
+    int64_t position = 0;
+    bool done = false;
+
+    bool create_avcodec(string const& codec_name)
+    {
+        avcodec = codec_find_encoder(codec_name);
+        if (nullptr == avcodec)
+            return false;
+
+        avcodec_context = codec_context_alloc(avcodec);
+        if (nullptr == avcodec_context)
+            return false;
+
+        //  a single thread and bitexact, for the same output on every run
+        avcodec_context->thread_count = 1;
+        avcodec_context->flags |= AV_CODEC_FLAG_BITEXACT;
+
+        return true;
+    }
+
+    bool open(format_context_ptr& avformat_context)
+    {
+        if (avformat_context->oformat->flags & AVFMT_GLOBALHEADER)
+            avcodec_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+        if (0 > avcodec_open2(avcodec_context.get(), avcodec.get(), nullptr))
+            return false;
+
+        avstream = avformat_new_stream(avformat_context.get(), nullptr);
+        if (nullptr == avstream)
+            return false;
+
+        avstream->time_base = avcodec_context->time_base;
+        if (0 > avcodec_parameters_from_context(avstream->codecpar, avcodec_context.get()))
+            return false;
+
+        return true;
+    }
+
+    //  source -> format -> sink, the generated frames are pulled from the sink
+    bool filter_init(char const* source_name, string const& source_argument,
+                     char const* format_name, string const& format_argument,
+                     char const* sink_name)
+    {
+        filter_graph = filter_graph_alloc();
+        if (nullptr == filter_graph)
+            return false;
+
+        AVFilterContext* source_context = nullptr;
+        AVFilterContext* format_context = nullptr;
+
+        if (0 > avfilter_graph_create_filter(&source_context,
+                                             avfilter_get_by_name(source_name),
+                                             "source",
+                                             source_argument.c_str(),
+                                             nullptr,
+                                             filter_graph.get()) ||
+            0 > avfilter_graph_create_filter(&format_context,
+                                             avfilter_get_by_name(format_name),
+                                             "format",
+                                             format_argument.c_str(),
+                                             nullptr,
+                                             filter_graph.get()) ||
+            0 > avfilter_graph_create_filter(&filter_context_sink,
+                                             avfilter_get_by_name(sink_name),
+                                             "sink",
+                                             nullptr,
+                                             nullptr,
+                                             filter_graph.get()))
+            return false;
+
+        if (0 > avfilter_link(source_context, 0, format_context, 0) ||
+            0 > avfilter_link(format_context, 0, filter_context_sink, 0))
+            return false;
+
+        if (avcodec_context->codec_type == AVMEDIA_TYPE_AUDIO &&
+            !(avcodec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE))
+            av_buffersink_set_frame_size(filter_context_sink, avcodec_context->frame_size);
+
+        if (0 > avfilter_graph_config(filter_graph.get(), nullptr))
+            return false;
+
+        return true;
+    }
+
+    //  generates the next frame, or flushes the encoder at the end,
+    //  and writes the packets the encoder gives back
+    bool step(format_context_ptr& avformat_context)
+    {
+        frame_unref(frame);
+        AVFrame* input = frame.get();
+
+        int response = av_buffersink_get_frame(filter_context_sink, frame.get());
+        if (response == AVERROR_EOF)
+        {
+            input = nullptr;
+            done = true;
+        }
+        else if (response < 0)
+            return false;
+        else
+        {
+            frame->pts = av_rescale_q(frame->pts,
+                                      av_buffersink_get_time_base(filter_context_sink),
+                                      avcodec_context->time_base);
+            if (avcodec_context->codec_type == AVMEDIA_TYPE_VIDEO)
+                frame->pict_type = AV_PICTURE_TYPE_NONE;
+            position = frame->pts;
+        }
+
+        if (0 > avcodec_send_frame(avcodec_context.get(), input))
+            return false;
+
+        while (true)
+        {
+            packet_unref(packet);
+            response = avcodec_receive_packet(avcodec_context.get(), packet.get());
+            if (response == AVERROR(EAGAIN) ||
+                response == AVERROR_EOF)
+                break;
+            else if (response < 0)
+                return false;
+
+            packet->stream_index = avstream->index;
+            av_packet_rescale_ts(packet.get(),
+                                 avcodec_context->time_base,
+                                 avstream->time_base);
+
+            if (0 != av_interleaved_write_frame(avformat_context.get(), packet.get()))
+                return false;
+        }
+
+        return true;
+    }
+};
+}
+
+bool test_source(filesystem::path const& output_file,
+                 test_source_options const& options)
+{
+    if (options.width <= 0 ||
+        options.height <= 0 ||
+        options.fps <= 0 ||
+        0 == options.duration)
+        return false;
+
+    string duration = std::to_string(options.duration / 1000) + "." +
+                      std::to_string(1000 + options.duration % 1000).substr(1);
+
+    auto avformat_context = format_context_alloc_output(output_file.string());
+    if (nullptr == avformat_context)
+        return false;
+    avformat_context->flags |= AVFMT_FLAG_BITEXACT;
+
+    vector<std::unique_ptr<TestSourceStream>> streams;
+
+    {
+        std::unique_ptr<TestSourceStream> video(new TestSourceStream());
+        if (false == video->create_avcodec(options.video_codec))
+            return false;
+
+        auto& context = *video->avcodec_context;
+        context.width = options.width;
+        context.height = options.height;
+        context.pix_fmt = AV_PIX_FMT_YUV420P;
+        context.time_base = AVRational{1, options.fps};
+        context.framerate = AVRational{options.fps, 1};
+        //  a keyframe every second, so that the input can be split into parts
+        context.gop_size = options.fps;
+
+        if (false == video->open(avformat_context))
+            return false;
+
+        if (options.rotation % 360)
+        {
+            uint8_t* displaymatrix = av_stream_new_side_data(video->avstream,
+                                                             AV_PKT_DATA_DISPLAYMATRIX,
+                                                             sizeof(int32_t) * 9);
+            if (nullptr == displaymatrix)
+                return false;
+
+            //  see get_rotation in libavwrapper for the sign
+            av_display_rotation_set(reinterpret_cast<int32_t*>(displaymatrix), -options.rotation);
+        }
+
+        if (false == video->filter_init("testsrc2",
+                                        "size=" + std::to_string(options.width) + "x" + std::to_string(options.height) +
+                                        ":rate=" + std::to_string(options.fps) +
+                                        ":duration=" + duration,
+                                        "format",
+                                        "pix_fmts=yuv420p",
+                                        "buffersink"))
+            return false;
+
+        streams.push_back(std::move(video));
+    }
+
+    if (options.audio)
+    {
+        std::unique_ptr<TestSourceStream> audio(new TestSourceStream());
+        if (false == audio->create_avcodec(options.audio_codec))
+            return false;
+
+        auto& context = *audio->avcodec_context;
+        context.sample_rate = 48000;
+        context.sample_fmt = AV_SAMPLE_FMT_FLTP;
+        context.channel_layout = AV_CH_LAYOUT_STEREO;
+        context.channels = 2;
+        context.time_base = AVRational{1, 48000};
+        context.bit_rate = 128000;
+
+        if (false == audio->open(avformat_context))
+            return false;
+
+        if (false == audio->filter_init("sine",
+                                        "frequency=440:sample_rate=48000:duration=" + duration,
+                                        "aformat",
+                                        "sample_fmts=fltp:channel_layouts=stereo",
+                                        "abuffersink"))
+            return false;
+
+        streams.push_back(std::move(audio));
+    }
+
+    beltpp::on_failure remove_output([&output_file]
+    {
+        boost::system::error_code ec;
+        filesystem::remove(output_file, ec);
+    });
+
+    if (!(avformat_context->oformat->flags & AVFMT_NOFILE) &&
+        0 > avio_open(&avformat_context->pb, output_file.string().c_str(), AVIO_FLAG_WRITE))
+        return false;
+    //  closed before the removal on failure
+    beltpp::finally close_output([&avformat_context]
+    {
+        if (!(avformat_context->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&avformat_context->pb);
+    });
+
+    if (0 > avformat_write_header(avformat_context.get(), nullptr))
+        return false;
+
+    while (true)
+    {
+        //  the stream that is behind goes next, to keep the muxer queue short
+        TestSourceStream* pnext = nullptr;
+        for (auto& stream : streams)
+        {
+            if (stream->done)
+                continue;
+            if (nullptr == pnext ||
+                0 > av_compare_ts(stream->position, stream->avcodec_context->time_base,
+                                  pnext->position, pnext->avcodec_context->time_base))
+                pnext = stream.get();
+        }
+
+        if (nullptr == pnext)
+            break;
+
+        if (false == pnext->step(avformat_context))
+            return false;
+    }
+
+    if (0 != av_write_trailer(avformat_context.get()))
+        return false;
+
+    remove_output.dismiss();
+    return true;
+}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+
+#include <string>
+#include <cstdint>
+
+namespace cloudy_bench
+{
+//  the synthetic input for the benchmarks, testsrc2 video with a sine tone.
+//  the output is the same on every run with the same ffmpeg build
+class test_source_options
+{
+public:
+    int width = 1280;
+    int height = 720;
+    int fps = 30;
+    //  in milliseconds
+    uint64_t duration = 10000;
+    //  clockwise, stored in the display matrix as the phones do, the frames are not rotated
+    int rotation = 0;
+    bool audio = true;
+    std::string video_codec = "libx264";
+    std::string audio_codec = "aac";
+};
+
+bool test_source(boost::filesystem::path const& output_file,
+                 test_source_options const& options);
+}
@@ -0,0 +1,376 @@
+#include "libavwrapper.hpp"
+#include "admin_model.hpp"
+
+#include "runner.hpp"
+#include "test_source.hpp"
+
+#include <belt.pp/packet.hpp>
+
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <exception>
+#include <utility>
+
+namespace program_options = boost::program_options;
+namespace filesystem = boost::filesystem;
+namespace chrono = std::chrono;
+
+using std::string;
+using std::vector;
+using std::pair;
+using std::cout;
+using std::endl;
+using cloudy_bench::measurement;
+using cloudy_bench::stopwatch;
+using cloudy_bench::runner;
+using cloudy_bench::peak_rss_reset;
+using cloudy_bench::peak_rss;
+using cloudy_bench::test_source_options;
+using cloudy_bench::test_source;
+
+using ladder_type = vector<pair<AdminModel::MediaTypeDescriptionVariant, size_t>>;
+
+namespace
+{
+bool process_command_line(int argc, char** argv,
+                          string& output,
+                          string& directory,
+                          size_t& repeat,
+                          string& filter,
+                          vector<string>& resolutions,
+                          vector<int>& fps,
+                          vector<int>& rotations,
+                          vector<uint64_t>& durations,
+                          string& ladder_file);
+
+//  as in the README example, h264 and aac in mp4
+AdminModel::MediaTypeDescriptionVariant profile(uint64_t width, uint64_t height, bool adjust)
+{
+    using FilterVariant = AdminModel::variant_type<AdminModel::MediaTypeDescriptionVideoFilter::rtt, AdminModel::MediaTypeDescriptionAudioFilter::rtt>;
+
+    AdminModel::MediaTypeDescriptionVideoFilter video_filter;
+    video_filter.adjust = adjust;
+    video_filter.height = height;
+    video_filter.width = width;
+    video_filter.fps = 29;
+    video_filter.rotate = 0;
+
+    AdminModel::MediaTypeDescriptionAVStreamTranscode video_transcode;
+    video_transcode.codec = "libx264";
+    video_transcode.parameters = {};
+    (*video_transcode.parameters)["preset"] = "fast";
+    video_transcode.filter = FilterVariant(beltpp::packet(std::move(video_filter)));
+
+    AdminModel::MediaTypeDescriptionAVStream video;
+    video.transcode = std::move(video_transcode);
+
+    AdminModel::MediaTypeDescriptionAVStreamTranscode audio_transcode;
+    audio_transcode.codec = "aac";
+
+    AdminModel::MediaTypeDescriptionAVStream audio;
+    audio.transcode = std::move(audio_transcode);
+
+    AdminModel::MediaTypeDescriptionAVContainer container;
+    container.video = std::move(video);
+    container.audio = std::move(audio);
+    container.container_extension = "mp4";
+
+    return AdminModel::MediaTypeDescriptionVariant(beltpp::packet(std::move(container)));
+}
+
+//  the same json array as the body of PUT /library
+ladder_type load_ladder(string const& ladder_file)
+{
+    ladder_type result;
+
+    if (ladder_file.empty())
+    {
+        result.push_back(std::make_pair(profile(1920, 1080, false), size_t(0)));
+        result.push_back(std::make_pair(profile(1280, 720, false), size_t(0)));
+        result.push_back(std::make_pair(profile(640, 360, true), size_t(0)));
+
+        return result;
+    }
+
+    std::ifstream file(ladder_file);
+    std::stringstream content;
+    content << file.rdbuf();
+    if (false == file.good())
+        throw std::runtime_error("cannot read " + ladder_file);
+
+    vector<AdminModel::MediaTypeDescriptionVariant> type_descriptions;
+    AdminModel::detail::loader(type_descriptions, content.str(), nullptr);
+
+    for (auto& type_description : type_descriptions)
+    {
+        //  the thumbnails and the raw types are not transcoded
+        if (type_description->type() == AdminModel::MediaTypeDescriptionAVContainer::rtt)
+            result.push_back(std::make_pair(std::move(type_description), size_t(0)));
+    }
+
+    if (result.empty())
+        throw std::runtime_error("no container profiles in " + ladder_file);
+
+    return result;
+}
+
+double seconds(chrono::steady_clock::duration const& value)
+{
+    return chrono::duration<double>(value).count();
+}
+
+string source_name(test_source_options const& options)
+{
+    return std::to_string(options.width) + "x" + std::to_string(options.height) + "_" +
+           std::to_string(options.fps) + "fps_" +
+           std::to_string(options.duration) + "ms_" +
+           "rot" + std::to_string(options.rotation);
+}
+}
+
+int main(int argc, char** argv)
+{
+    string output;
+    string directory;
+    size_t repeat = 3;
+    string filter;
+    vector<string> resolutions = {"640x360", "1280x720", "1920x1080"};
+    vector<int> fps = {30};
+    vector<int> rotations = {0, 90};
+    vector<uint64_t> durations = {10000};
+    string ladder_file;
+
+    if (false == process_command_line(argc, argv,
+                                      output,
+                                      directory,
+                                      repeat,
+                                      filter,
+                                      resolutions,
+                                      fps,
+                                      rotations,
+                                      durations,
+                                      ladder_file))
+        return 1;
+
+    try
+    {
+        ladder_type const ladder = load_ladder(ladder_file);
+
+        filesystem::path bench_directory(directory);
+        if (bench_directory.empty())
+            bench_directory = filesystem::temp_directory_path() / filesystem::unique_path("cloudy_transcode_bench_%%%%%%%%");
+
+        //  the sources are the same on every run, and are kept with the given directory
+        filesystem::path source_directory = bench_directory / "sources";
+        filesystem::create_directories(source_directory);
+
+        runner bench(bench_directory / "output", repeat, filter);
+
+        for (auto const& resolution : resolutions)
+        for (int fps_item : fps)
+        for (int rotation : rotations)
+        for (uint64_t duration : durations)
+        {
+            test_source_options source_options;
+            source_options.fps = fps_item;
+            source_options.rotation = rotation;
+            source_options.duration = duration;
+
+            size_t pos = resolution.find('x');
+            if (string::npos == pos)
+                throw std::runtime_error("resolution: " + resolution);
+            source_options.width = std::stoi(resolution.substr(0, pos));
+            source_options.height = std::stoi(resolution.substr(pos + 1));
+
+            string name = source_name(source_options);
+            if (false == filter.empty() &&
+                string::npos == ("transcode_" + name).find(filter))
+                continue;
+
+            filesystem::path source = source_directory / ("testsrc2_" + name + ".mp4");
+            if (false == filesystem::exists(source))
+            {
+                stopwatch timer;
+                if (false == test_source(source, source_options))
+                    throw std::runtime_error("cannot generate " + source.string());
+                std::cerr << source.filename().string() << ": generated in " << timer.seconds() << "s" << endl;
+            }
+
+            bench.run("transcode_" + name, [&ladder, source, duration](filesystem::path const& path)
+            {
+                //  init refines the options to what is actually done
+                ladder_type options = ladder;
+
+                libavwrapper::transcoder transcoder;
+                transcoder.input_file = source;
+                transcoder.output_dir = path;
+
+                measurement result;
+
+                peak_rss_reset();
+                stopwatch timer;
+
+                if (false == transcoder.init(options))
+                    throw std::runtime_error("transcoder::init: false, " + source.string());
+
+                uint64_t output_bytes = 0;
+                size_t outputs = 0;
+                while (true)
+                {
+                    auto progress = transcoder.run();
+                    if (progress.empty())
+                        break;
+
+                    for (auto const& item : progress)
+                    {
+                        output_bytes += item.second.data_size;
+                        ++outputs;
+                    }
+                }
+
+                result.seconds = timer.seconds();
+
+                if (outputs != options.size())
+                    throw std::runtime_error("transcoder::run: outputs != options.size(), " + source.string());
+
+                auto timings = transcoder.timings();
+
+                //  the operations are the decoded video frames, shared by all the profiles
+                result.operations = transcoder.frames();
+                result.extra.push_back(std::make_pair(string("profiles"), double(options.size())));
+                result.extra.push_back(std::make_pair(string("source_seconds"), double(duration) / 1000));
+                result.extra.push_back(std::make_pair(string("realtime_factor"), double(duration) / 1000 / result.seconds));
+                result.extra.push_back(std::make_pair(string("demux_seconds"), seconds(timings.demux)));
+                result.extra.push_back(std::make_pair(string("decode_seconds"), seconds(timings.decode)));
+                result.extra.push_back(std::make_pair(string("filter_seconds"), seconds(timings.filter)));
+                result.extra.push_back(std::make_pair(string("encode_seconds"), seconds(timings.encode)));
+                result.extra.push_back(std::make_pair(string("mux_seconds"), seconds(timings.mux)));
+                result.extra.push_back(std::make_pair(string("shared_audio"), double(timings.shared_audio)));
+                result.extra.push_back(std::make_pair(string("shared_audio_saved_seconds"), seconds(timings.shared_audio_saved)));
+                result.extra.push_back(std::make_pair(string("output_bytes"), double(output_bytes)));
+                result.extra.push_back(std::make_pair(string("peak_rss_bytes"), peak_rss()));
+
+                return result;
+            });
+        }
+
+        filesystem::remove_all(bench_directory / "output");
+        if (directory.empty())
+            filesystem::remove_all(bench_directory);
+
+        string json = bench.json();
+        if (output.empty())
+            cout << json;
+        else
+        {
+            std::ofstream file(output);
+            file << json;
+            if (false == file.good())
+                throw std::runtime_error("cannot write " + output);
+        }
+    }
+    catch (std::exception const& ex)
+    {
+        cout << "exception cought: " << ex.what() << endl;
+        return 1;
+    }
+    catch (...)
+    {
+        cout << "always throw std::exceptions" << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+namespace
+{
+bool process_command_line(int argc, char** argv,
+                          string& output,
+                          string& directory,
+                          size_t& repeat,
+                          string& filter,
+                          vector<string>& resolutions,
+                          vector<int>& fps,
+                          vector<int>& rotations,
+                          vector<uint64_t>& durations,
+                          string& ladder_file)
+{
+    program_options::options_description options_description;
+    try
+    {
+        auto desc_init = options_description.add_options()
+            ("help,h", "print this help message and exit.")
+            ("output,o", program_options::value<string>(&output),
+                            "the json file to write the results to, stdout by default")
+            ("directory,d", program_options::value<string>(&directory),
+                            "where the generated sources are kept, a temporary directory by default")
+            ("repeat,r", program_options::value<size_t>(&repeat),
+                            "how many times to run each transcode, the median is reported")
+            ("filter,f", program_options::value<string>(&filter),
+                            "run only the transcodes with this in the name")
+            ("resolutions", program_options::value<vector<string>>(&resolutions)->multitoken(),
+                            "the source resolutions, as 1280x720")
+            ("fps", program_options::value<vector<int>>(&fps)->multitoken(),
+                            "the source frame rates")
+            ("rotations", program_options::value<vector<int>>(&rotations)->multitoken(),
+                            "the source rotations in degrees, stored in the display matrix")
+            ("durations", program_options::value<vector<uint64_t>>(&durations)->multitoken(),
+                            "the source durations, in milliseconds")
+            ("ladder", program_options::value<string>(&ladder_file),
+                            "the json file with the profiles, as in PUT /library. 1080p, 720p and 360p by default");
+        (void)(desc_init);
+
+        program_options::variables_map options;
+
+        program_options::store(
+                    program_options::parse_command_line(argc, argv, options_description),
+                    options);
+
+        program_options::notify(options);
+
+        if (options.count("help"))
+        {
+            throw std::runtime_error("");
+        }
+
+        if (0 == repeat)
+            throw std::runtime_error("repeat must be positive");
+        for (auto value : fps)
+        {
+            if (value <= 0)
+                throw std::runtime_error("fps must be positive");
+        }
+        for (auto value : durations)
+        {
+            if (0 == value)
+                throw std::runtime_error("durations must be positive");
+        }
+    }
+    catch (std::exception const& ex)
+    {
+        std::stringstream ss;
+        ss << options_description;
+
+        string ex_message = ex.what();
+        if (false == ex_message.empty())
+            cout << ex.what() << endl << endl;
+        cout << ss.str();
+        return false;
+    }
+    catch (...)
+    {
+        cout << "always throw std::exceptions" << endl;
+        return false;
+    }
+
+    return true;
+}
+}
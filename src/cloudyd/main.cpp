@@ -1,6 +1,7 @@
 #include <cloudy/admin_server.hpp>
 #include <cloudy/storage_server.hpp>
 #include <cloudy/worker.hpp>
+#include <cloudy/spsc_ring.hpp>
 
 #include <belt.pp/log.hpp>
 #include <belt.pp/scope_helper.hpp>
@@ -20,6 +21,7 @@
 #include <exception>
 #include <thread>
 #include <string>
+#include <chrono>
 
 #include <csignal>
 
@@ -37,7 +39,14 @@ bool process_command_line(int argc, char** argv,
                           beltpp::ip_address& admin_bind_to_address,
                           beltpp::ip_address& storage_bind_to_address,
                           string& data_directory,
-                          meshpp::private_key& pv_key);
+                          meshpp::private_key& pv_key,
+                          uint64_t& index_concurrency,
+                          uint64_t& log_retention,
+                          uint64_t& group_commit_window,
+                          uint64_t& event_batch_size,
+                          uint64_t& transcode_threads,
+                          uint64_t& segment_duration,
+                          uint64_t& storage_in_flight_limit);
 
 static bool g_termination_handled = false;
 static cloudy::admin_server* g_admin = nullptr;
@@ -80,12 +89,26 @@ int main(int argc, char** argv)
     string data_directory;
     meshpp::random_seed seed;
     meshpp::private_key pv_key = seed.get_private_key(0);
+    uint64_t index_concurrency = 3;
+    uint64_t log_retention = 10000;
+    uint64_t group_commit_window = 0;
+    uint64_t event_batch_size = 1;
+    uint64_t transcode_threads = 1;
+    uint64_t segment_duration = 0;
+    uint64_t storage_in_flight_limit = 16;
 
     if (false == process_command_line(argc, argv,
                                       admin_bind_to_address,
                                       storage_bind_to_address,
                                       data_directory,
-                                      pv_key))
+                                      pv_key,
+                                      index_concurrency,
+                                      log_retention,
+                                      group_commit_window,
+                                      event_batch_size,
+                                      transcode_threads,
+                                      segment_duration,
+                                      storage_in_flight_limit))
         return 1;
 
     if (false == data_directory.empty())
@@ -152,13 +175,20 @@ int main(int argc, char** argv)
                                                          fs_log / "worker_exceptions.txt");
 
         beltpp::direct_channel direct_channel;
+        //  the worker results are the most of the traffic between the threads
+        cloudy::spsc_ring<beltpp::packet> worker_results;
 
         cloudy::admin_server admin(admin_bind_to_address,
                                    fs_library,
                                    fs_admin,
                                    pv_key,
                                    plogger_admin.get(),
-                                   direct_channel);
+                                   direct_channel,
+                                   worker_results,
+                                   index_concurrency,
+                                   log_retention,
+                                   std::chrono::milliseconds(group_commit_window),
+                                   event_batch_size);
 
         g_admin = &admin;
 
@@ -170,9 +200,15 @@ int main(int argc, char** argv)
                                        direct_channel);
         g_storage = &storage;
 
+        //  one more thread for the media check running along with the hashing
         cloudy::worker worker(plogger_worker.get(),
                               fs_worker,
-                              direct_channel);
+                              direct_channel,
+                              worker_results,
+                              index_concurrency + 1,
+                              transcode_threads,
+                              segment_duration,
+                              storage_in_flight_limit);
         g_worker = &worker;
 
         {
@@ -272,7 +308,14 @@ bool process_command_line(int argc, char** argv,
                           beltpp::ip_address& admin_bind_to_address,
                           beltpp::ip_address& storage_bind_to_address,
                           string& data_directory,
-                          meshpp::private_key& pv_key)
+                          meshpp::private_key& pv_key,
+                          uint64_t& index_concurrency,
+                          uint64_t& log_retention,
+                          uint64_t& group_commit_window,
+                          uint64_t& event_batch_size,
+                          uint64_t& transcode_threads,
+                          uint64_t& segment_duration,
+                          uint64_t& storage_in_flight_limit)
 {
     string admin_bind_interface;
     string storage_bind_interface;
@@ -290,7 +333,21 @@ bool process_command_line(int argc, char** argv,
             ("data-directory,d", program_options::value<string>(&data_directory),
                             "Data directory path")
             ("daemon-private-key,k", program_options::value<string>(&str_pv_key),
-                            "daemon private key");
+                            "daemon private key")
+            ("index-concurrency", program_options::value<uint64_t>(&index_concurrency),
+                            "how many files can be hashed at the same time")
+            ("log-retention", program_options::value<uint64_t>(&log_retention),
+                            "how many of the latest admin log entries to keep")
+            ("group-commit-window", program_options::value<uint64_t>(&group_commit_window),
+                            "milliseconds the admin data commit may trail the answer, a packet saved in the meantime commits the earlier ones first")
+            ("event-batch-size", program_options::value<uint64_t>(&event_batch_size),
+                            "how many of the admin packets received at once are processed before the commit is due")
+            ("transcode-threads", program_options::value<uint64_t>(&transcode_threads),
+                            "how many parts of a long video can be transcoded at the same time")
+            ("segment-duration", program_options::value<uint64_t>(&segment_duration),
+                            "milliseconds, cut all the profiles of a video into segments of this duration, for adaptive streaming. each segment starts with an idr frame in every profile. a video is transcoded by one thread then")
+            ("storage-in-flight-limit", program_options::value<uint64_t>(&storage_in_flight_limit),
+                            "how many media check results can wait for storage before the transcode pauses, 0 for no limit");
         (void)(desc_init);
 
         program_options::variables_map options;
@@ -311,6 +368,15 @@ bool process_command_line(int argc, char** argv,
 
         if (false == str_pv_key.empty())
             pv_key = meshpp::private_key(str_pv_key);
+
+        if (0 == index_concurrency)
+            throw std::runtime_error("index-concurrency must be positive");
+        if (0 == log_retention)
+            throw std::runtime_error("log-retention must be positive");
+        if (0 == event_batch_size)
+            throw std::runtime_error("event-batch-size must be positive");
+        if (0 == transcode_threads)
+            throw std::runtime_error("transcode-threads must be positive");
     }
     catch (std::exception const& ex)
     {
@@ -2,6 +2,8 @@
 
 #include "admin_model.hpp"
 #include "common.hpp"
+#include "metrics.hpp"
+#include "tracing.hpp"
 
 #include <belt.pp/parser.hpp>
 #include <belt.pp/http.hpp>
@@ -49,6 +51,24 @@ string response_log(beltpp::detail::session_special_data& ssd,
     else
         return beltpp::http::http_internal_server_error(ssd, pc.to_string());
 }
+inline
+string response_queue(beltpp::detail::session_special_data& ssd,
+                      beltpp::packet const& pc)
+{
+    if (pc.type() == QueueStatus::rtt)
+        return beltpp::http::http_response(ssd, pc.to_string());
+    else
+        return beltpp::http::http_internal_server_error(ssd, pc.to_string());
+}
+inline
+string response_watch(beltpp::detail::session_special_data& ssd,
+                      beltpp::packet const& pc)
+{
+    if (pc.type() == WatchList::rtt)
+        return beltpp::http::http_response(ssd, pc.to_string());
+    else
+        return beltpp::http::http_internal_server_error(ssd, pc.to_string());
+}
 inline string response_index_list(beltpp::detail::session_special_data& ssd,
                                   beltpp::packet const& pc)
 {
@@ -216,6 +236,13 @@ beltpp::detail::pmsg_all message_list_load(
 
             AdminModel::detail::loader(ref.type_descriptions, posted, nullptr);
 
+            auto it_priority = ss.resource.arguments.find("priority");
+            if (it_priority != ss.resource.arguments.end())
+            {
+                size_t pos = 0;
+                ref.priority = beltpp::stoui64(it_priority->second, pos);
+            }
+
             return ::beltpp::detail::pmsg_all(LibraryPut::rtt,
                                               std::move(p),
                                               &LibraryPut::pvoid_saver);
@@ -240,7 +267,20 @@ beltpp::detail::pmsg_all message_list_load(
         {
             ssd.session_specal_handler = &response_log;
             auto p = ::beltpp::new_void_unique_ptr<LogGet>();
-            //LogGet& ref = *reinterpret_cast<LogGet*>(p.get());
+            LogGet& ref = *reinterpret_cast<LogGet*>(p.get());
+
+            auto it_since = ss.resource.arguments.find("since");
+            if (it_since != ss.resource.arguments.end())
+            {
+                size_t pos = 0;
+                ref.since = beltpp::stoui64(it_since->second, pos);
+            }
+            auto it_limit = ss.resource.arguments.find("limit");
+            if (it_limit != ss.resource.arguments.end())
+            {
+                size_t pos = 0;
+                ref.limit = beltpp::stoui64(it_limit->second, pos);
+            }
 
             return ::beltpp::detail::pmsg_all(LogGet::rtt,
                                               std::move(p),
@@ -261,6 +301,59 @@ beltpp::detail::pmsg_all message_list_load(
                                               std::move(p),
                                               &LogDelete::pvoid_saver);
         }
+        else if (ss.type == beltpp::http::detail::scan_status::get &&
+                 ss.resource.path.size() == 1 &&
+                 ss.resource.path.front() == "queue")
+        {
+            ssd.session_specal_handler = &response_queue;
+            auto p = ::beltpp::new_void_unique_ptr<QueueGet>();
+
+            return ::beltpp::detail::pmsg_all(QueueGet::rtt,
+                                              std::move(p),
+                                              &QueueGet::pvoid_saver);
+        }
+        else if (ss.type == beltpp::http::detail::scan_status::get &&
+                 ss.resource.path.size() == 1 &&
+                 ss.resource.path.front() == "watch")
+        {
+            ssd.session_specal_handler = &response_watch;
+            auto p = ::beltpp::new_void_unique_ptr<WatchGet>();
+
+            return ::beltpp::detail::pmsg_all(WatchGet::rtt,
+                                              std::move(p),
+                                              &WatchGet::pvoid_saver);
+        }
+        else if (ss.type == beltpp::http::detail::scan_status::put &&
+                 ss.resource.path.size() > 1 &&
+                 false == posted.empty() &&
+                 ss.resource.path.front() == "watch")
+        {
+            ssd.session_specal_handler = &response_watch;
+            auto p = ::beltpp::new_void_unique_ptr<WatchPut>();
+            WatchPut& ref = *reinterpret_cast<WatchPut*>(p.get());
+            for (size_t index = 1; index != ss.resource.path.size(); ++index)
+                ref.path.push_back(ss.resource.path[index]);
+
+            AdminModel::detail::loader(ref.type_descriptions, posted, nullptr);
+
+            return ::beltpp::detail::pmsg_all(WatchPut::rtt,
+                                              std::move(p),
+                                              &WatchPut::pvoid_saver);
+        }
+        else if (ss.type == beltpp::http::detail::scan_status::del &&
+                 ss.resource.path.size() > 1 &&
+                 ss.resource.path.front() == "watch")
+        {
+            ssd.session_specal_handler = &response_watch;
+            auto p = ::beltpp::new_void_unique_ptr<WatchDelete>();
+            WatchDelete& ref = *reinterpret_cast<WatchDelete*>(p.get());
+            for (size_t index = 1; index != ss.resource.path.size(); ++index)
+                ref.path.push_back(ss.resource.path[index]);
+
+            return ::beltpp::detail::pmsg_all(WatchDelete::rtt,
+                                              std::move(p),
+                                              &WatchDelete::pvoid_saver);
+        }
         else if (ss.type == beltpp::http::detail::scan_status::get &&
                  ss.resource.path.size() == 1 &&
                  ss.resource.path.front() == "authorization")
@@ -301,6 +394,44 @@ beltpp::detail::pmsg_all message_list_load(
                                               ::beltpp::void_unique_nullptr(),
                                               nullptr);
         }
+        else if (ss.type == beltpp::http::detail::scan_status::get &&
+                 ss.resource.path.size() == 1 &&
+                 ss.resource.path.front() == "metrics")
+        {
+            ssd.session_specal_handler = nullptr;
+
+            string metrics_buffer = metrics::scrape();
+
+            string metrics_result;
+            metrics_result += "HTTP/1.1 200 OK\r\n";
+            metrics_result += "Content-Type: text/plain; version=0.0.4\r\n";
+            metrics_result += "Content-Length: ";
+            metrics_result += std::to_string(metrics_buffer.size());
+            metrics_result += "\r\n\r\n";
+            metrics_result += metrics_buffer;
+
+            ssd.autoreply = metrics_result;
+
+            return ::beltpp::detail::pmsg_all(size_t(-1),
+                                              ::beltpp::void_unique_nullptr(),
+                                              nullptr);
+        }
+        else if (ss.type == beltpp::http::detail::scan_status::get &&
+                 false == ss.resource.path.empty() &&
+                 ss.resource.path.front() == "trace")
+        {
+            ssd.session_specal_handler = nullptr;
+
+            string item;
+            for (size_t index = 1; index != ss.resource.path.size(); ++index)
+                item += "/" + ss.resource.path[index];
+
+            ssd.autoreply = beltpp::http::http_response(ssd, trace::chrome_json(item));
+
+            return ::beltpp::detail::pmsg_all(size_t(-1),
+                                              ::beltpp::void_unique_nullptr(),
+                                              nullptr);
+        }
         else if (ss.type == beltpp::http::detail::scan_status::get &&
                  ss.resource.path.size() == 1 &&
                  ss.resource.path.front() == "protocol")
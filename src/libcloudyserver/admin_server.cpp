@@ -5,6 +5,9 @@
 #include "admin_model.hpp"
 #include "internal_model.hpp"
 #include "library.hpp"
+#include "event_log.hpp"
+#include "metrics.hpp"
+#include "tracing.hpp"
 
 #include <belt.pp/socket.hpp>
 #include <belt.pp/packet.hpp>
@@ -19,8 +22,11 @@
 #include <memory>
 #include <chrono>
 #include <vector>
+#include <deque>
 #include <utility>
 #include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
 
 namespace cloudy
 {
@@ -36,6 +42,7 @@ using beltpp::timer;
 namespace filesystem = boost::filesystem;
 
 using std::unordered_set;
+using std::unordered_map;
 using std::unique_ptr;
 namespace chrono = std::chrono;
 using std::vector;
@@ -53,6 +60,28 @@ namespace detail
 {
 using rpc_sf = beltpp::socket_family_t<&http::message_list_load<&AdminModel::message_list_load>>;
 
+//  the http requests are measured by route, the rest are not requests
+char const* route_name(size_t rtt)
+{
+    switch (rtt)
+    {
+    case AdminModel::IndexListGet::rtt: return "index_list";
+    case AdminModel::IndexGet::rtt: return "index_get";
+    case AdminModel::IndexDelete::rtt: return "index_delete";
+    case AdminModel::LibraryGet::rtt: return "library_get";
+    case AdminModel::LibraryPut::rtt: return "library_put";
+    case AdminModel::LibraryDelete::rtt: return "library_delete";
+    case AdminModel::LogGet::rtt: return "log_get";
+    case AdminModel::LogDelete::rtt: return "log_delete";
+    case AdminModel::QueueGet::rtt: return "queue_get";
+    case AdminModel::WatchGet::rtt: return "watch_get";
+    case AdminModel::WatchPut::rtt: return "watch_put";
+    case AdminModel::WatchDelete::rtt: return "watch_delete";
+    case AdminModel::StorageAuthorization::rtt: return "authorization";
+    default: return nullptr;
+    }
+}
+
 class admin_server_internals
 {
 public:
@@ -61,33 +90,127 @@ public:
     socket_ptr ptr_socket;
 
     beltpp::stream_ptr ptr_direct_stream;
+    spsc_ring<packet>& worker_results;
 
     cloudy::library library;
-    meshpp::file_loader<AdminModel::Log,
-                        &AdminModel::Log::from_string,
-                        &AdminModel::Log::to_string> log;
+    event_log log;
+    tracked_file_loader<meshpp::file_loader<AdminModel::WatchList,
+                                            &AdminModel::WatchList::from_string,
+                                            &AdminModel::WatchList::to_string>> watch;
+
+    bool watch_changed;
+    unordered_set<string> watch_replacing;
 
     vector<InternalModel::ProcessMediaCheckResult> pending_for_storage;
+    //  sent to storage as batches on the next run, each batch is a single storage transaction
+    vector<StorageModel::StorageFileAdd> storage_adds;
+    vector<string> storage_deletes;
+    //  how many of pending_for_storage each sent storage request acknowledges, in the order sent
+    std::deque<size_t> storage_requests;
+    //  the results storage acknowledged since the last credit sent to worker
+    uint64_t storage_credits;
+    //  the latest progress of the transcodes running, by path
+    unordered_map<string, AdminModel::TranscodeStatus> transcoding;
 
     meshpp::private_key pv_key;
     wait_result wait_result_info;
+    //  the packets received by a single wait, processed back to back
+    std::deque<wait_result_item> batch;
+    size_t batch_size;
+    size_t batch_processed;
+
+    chrono::steady_clock::duration group_commit_window;
+    chrono::steady_clock::time_point last_commit;
+    chrono::steady_clock::time_point last_timer_action;
+    bool commit_pending;
+    uint64_t events;
+    uint64_t saves;
+    save_statistics statistics_reported;
+    uint64_t results_reported;
+    uint64_t wakes_reported;
+
+    unordered_map<size_t, metrics::route> routes;
+    metrics::histogram save_duration;
+    metrics::histogram commit_duration;
+    metrics::gauge queue_index;
+    metrics::gauge queue_media_check;
+    metrics::gauge queue_storage;
 
     admin_server_internals(ip_address const& bind_to_address,
                            filesystem::path const& fs_library,
                            filesystem::path const& fs_admin,
                            meshpp::private_key const& _pv_key,
                            ilog* _plogger,
-                           beltpp::direct_channel& channel)
+                           beltpp::direct_channel& channel,
+                           spsc_ring<packet>& _worker_results,
+                           uint64_t index_concurrency,
+                           uint64_t log_retention,
+                           chrono::steady_clock::duration const& _group_commit_window,
+                           uint64_t _batch_size)
         : plogger(_plogger)
         , ptr_eh(beltpp::libsocket::construct_event_handler())
         , ptr_socket(beltpp::libsocket::getsocket<rpc_sf>(*ptr_eh))
         , ptr_direct_stream(beltpp::construct_direct_stream(admin_peerid, *ptr_eh, channel))
-        , library(fs_library)
-        , log(fs_admin / "log.json")
+        , worker_results(_worker_results)
+        , library(fs_library, index_concurrency)
+        , log(fs_admin / "log", log_retention)
+        , watch(fs_admin / "watch.json")
+        , watch_changed(true)
+        , watch_replacing()
         , pending_for_storage()
+        , storage_adds()
+        , storage_deletes()
+        , storage_requests()
+        , storage_credits(0)
+        , transcoding()
         , pv_key(_pv_key)
+        , batch()
+        , batch_size(_batch_size ? _batch_size : 1)
+        , batch_processed(0)
+        , group_commit_window(_group_commit_window)
+        , last_commit(chrono::steady_clock::now())
+        , last_timer_action(last_commit)
+        , commit_pending(false)
+        , events(0)
+        , saves(0)
+        , statistics_reported()
+        , results_reported(0)
+        , wakes_reported(0)
+        , routes()
+        , save_duration("cloudy_admin_save_seconds", "time to save the admin state")
+        , commit_duration("cloudy_admin_commit_seconds", "time to commit the saved admin state")
+        , queue_index("cloudy_queue_depth", "items waiting, by queue", "queue=\"index\"")
+        , queue_media_check("cloudy_queue_depth", "items waiting, by queue", "queue=\"media_check\"")
+        , queue_storage("cloudy_queue_depth", "items waiting, by queue", "queue=\"storage\"")
     {
-        ptr_eh->set_timer(event_timer_period);
+        worker_results.set_consumer_wake([this]{ ptr_eh->wake(); });
+
+        //  the timer also flushes the postponed group commit
+        if (group_commit_window > chrono::steady_clock::duration::zero() &&
+            group_commit_window < event_timer_period)
+            ptr_eh->set_timer(group_commit_window);
+        else
+            ptr_eh->set_timer(event_timer_period);
+
+        //  the log used to be a single file
+        filesystem::path legacy_log_path = fs_admin / "log.json";
+        if (filesystem::exists(legacy_log_path))
+        {
+            {
+                //  written before since and next were there, that's why they are optional
+                meshpp::file_loader<AdminModel::Log,
+                                    &AdminModel::Log::from_string,
+                                    &AdminModel::Log::to_string> legacy_log(legacy_log_path);
+
+                beltpp::on_failure guard([this]{ log.discard(); });
+                for (auto& entry : legacy_log->log)
+                    log.push(std::move(entry));
+                log.save();
+                guard.dismiss();
+                log.commit();
+            }
+            filesystem::remove(legacy_log_path);
+        }
 
         if (bind_to_address.local.empty())
             throw std::logic_error("bind_to_address.local.empty()");
@@ -111,26 +234,199 @@ public:
 
     void save()
     {
+        //  a save that fails half way leaves the loaders before it with the failed packet,
+        //  so the earlier packets are committed before, not along with it
+        if (commit_pending)
+            commit();
+
+        metrics::timer timer(save_duration);
+
         library.save();
         log.save();
+        watch.save();
     }
 
     void commit() noexcept
     {
+        metrics::timer timer(commit_duration);
+
         library.commit();
         log.commit();
+        watch.commit();
+
+        last_commit = chrono::steady_clock::now();
+        commit_pending = false;
+        batch_processed = 0;
+        ++saves;
     }
 
+    //  every packet is saved on its own, only the commit is postponed within the group
+    //  commit window, or until the last packet of a batch. the next save or the timer
+    //  commits the rest
+    bool commit_postponed()
+    {
+        ++events;
+        ++batch_processed;
+
+        if ((batch.empty() || batch_processed >= batch_size) &&
+            chrono::steady_clock::now() - last_commit >= group_commit_window)
+            return false;
+
+        commit_pending = true;
+        return true;
+    }
+
+    save_statistics statistics() const
+    {
+        save_statistics result = library.statistics();
+        for (auto const& statistics : {log.statistics(), watch.statistics})
+        {
+            result.files += statistics.files;
+            result.bytes += statistics.bytes;
+        }
+
+        return result;
+    }
+
+    void report_statistics(chrono::steady_clock::duration const& period)
+    {
+        auto totals = statistics();
+
+        if (events)
+        {
+            uint64_t milliseconds = uint64_t(chrono::duration_cast<chrono::milliseconds>(period).count());
+            if (0 == milliseconds)
+                milliseconds = 1;
+            uint64_t bytes = totals.bytes - statistics_reported.bytes;
+
+            writeln_node("admin: " + std::to_string(events) + " events, " +
+                         std::to_string(saves) + " saves (" +
+                         std::to_string(saves * 1000 / milliseconds) + "/s), " +
+                         std::to_string(totals.files - statistics_reported.files) + " files, " +
+                         std::to_string(bytes) + " bytes (" +
+                         std::to_string(bytes / events) + "/event)");
+        }
+
+        uint64_t results = worker_results.pushed_count();
+        uint64_t wakes = worker_results.wake_count();
+        if (results != results_reported)
+            writeln_node("admin: " + std::to_string(results - results_reported) + " worker results, " +
+                         std::to_string(wakes - wakes_reported) + " wake-ups, " +
+                         std::to_string(storage_in_flight()) + " in flight to storage");
+        results_reported = results;
+        wakes_reported = wakes;
+
+        events = 0;
+        saves = 0;
+        statistics_reported = totals;
+    }
+
+    metrics::route const* route(size_t rtt)
+    {
+        auto it = routes.find(rtt);
+        if (it != routes.end())
+            return &it->second;
+
+        char const* name = route_name(rtt);
+        if (nullptr == name)
+            return nullptr;
+
+        return &routes.insert(std::make_pair(rtt, metrics::route("admin", name))).first->second;
+    }
+
+    //  refreshed on the timer, counting the library queues is not free
+    void update_queue_metrics()
+    {
+        int64_t pending_for_index = 0;
+        int64_t pending_for_media_check = 0;
+
+        for (auto const& depth : library.queue().depths)
+        {
+            pending_for_index += int64_t(depth.pending_for_index);
+            pending_for_media_check += int64_t(depth.pending_for_media_check);
+        }
+
+        queue_index.set(pending_for_index);
+        queue_media_check.set(pending_for_media_check);
+        queue_storage.set(int64_t(pending_for_storage.size()));
+    }
+
+    //  drops the changes of the failed packet only. the earlier packets are saved
+    //  and already answered, so the postponed commit is done first. it is pending only
+    //  if the packet failed before save, see save
     void discard() noexcept
     {
+        if (commit_pending)
+            commit();
+
         library.discard();
         log.discard();
+        watch.discard();
     }
 
     void clear()
     {
         library.clear();
-        log->log.clear();
+        log.clear();
+        watch->items.clear();
+    }
+
+    void replace_watched(vector<string> const& path, string const& sha256sum)
+    {
+        //  a watched file that changed in place, replaces the previous version
+        auto it = watch_replacing.find(join_path(path).first);
+        if (it == watch_replacing.end())
+            return;
+        watch_replacing.erase(it);
+
+        auto existing_info = library.info(path);
+        if (existing_info.type() != AdminModel::FileItem::rtt)
+            return;
+
+        AdminModel::FileItem file_item;
+        std::move(existing_info).get(file_item);
+
+        if (!file_item.checksum || *file_item.checksum == sha256sum)
+            return;
+
+        writeln_node(join_path(path).first + ": changed, replacing " + *file_item.checksum);
+
+        auto uris = library.delete_library(path);
+        storage_deletes.insert(storage_deletes.end(), uris.begin(), uris.end());
+    }
+
+    void send_storage_batches()
+    {
+        if (false == storage_adds.empty())
+        {
+            StorageModel::StorageFileAddBatch request;
+            request.files = std::move(storage_adds);
+            storage_adds.clear();
+
+            storage_requests.push_back(request.files.size());
+            ptr_direct_stream->send(storage_peerid, packet(std::move(request)));
+        }
+
+        if (false == storage_deletes.empty())
+        {
+            StorageModel::StorageFileDeleteBatch request;
+            request.uris = std::move(storage_deletes);
+            storage_deletes.clear();
+
+            storage_requests.push_back(0);
+            ptr_direct_stream->send(storage_peerid, packet(std::move(request)));
+        }
+    }
+
+    size_t storage_responded()
+    {
+        if (storage_requests.empty())
+            throw std::logic_error("storage_responded: storage_requests.empty()");
+
+        size_t result = storage_requests.front();
+        storage_requests.pop_front();
+
+        return result;
     }
 
     void process_storage(InternalModel::ProcessMediaCheckResult&& pending_data)
@@ -152,6 +448,16 @@ public:
                 (*pending_data.type_description)->get(pdesc);
                 str_mime_type = pdesc->mime_type;
             }
+            else if (pending_data.type_description &&
+                     (*pending_data.type_description)->type() == AdminModel::MediaTypeDescriptionThumbnails::rtt)
+            {
+                AdminModel::MediaTypeDescriptionThumbnails const* pdesc;
+                (*pending_data.type_description)->get(pdesc);
+                if (pdesc->container_extension == "jpg")
+                    str_mime_type = "image/jpeg";
+                else
+                    str_mime_type = "image/" + pdesc->container_extension;
+            }
 
             if (pending_data.result_type == InternalModel::ResultType::data)
             {
@@ -159,15 +465,20 @@ public:
                 file.data = std::move(data);
 
                 file.mime_type = str_mime_type;
+                //  the responses must follow the order of pending_for_storage
+                send_storage_batches();
+                storage_requests.push_back(1);
                 ptr_direct_stream->send(storage_peerid, packet(std::move(file)));
             }
             else
             {
                 StorageModel::StorageFileAdd file;
                 file.file = std::move(data);
+                if (pending_data.data_hash)
+                    file.hash = *pending_data.data_hash;
 
                 file.mime_type = str_mime_type;
-                ptr_direct_stream->send(storage_peerid, packet(std::move(file)));
+                storage_adds.push_back(std::move(file));
             }
             pending_for_storage.push_back(std::move(pending_data));
         }
@@ -207,6 +518,14 @@ public:
         do
         {
             auto&& progress_info = pending_for_storage.front();
+            if (progress_info.count)
+            {
+                ++storage_credits;
+                if (uri.empty())
+                    trace::instant(join_path(progress_info.path).first, "storage_error", error_override);
+                else
+                    trace::instant(join_path(progress_info.path).first, "storage_put", uri);
+            }
             process_pending.push_back(std::move(progress_info));
 
             pending_for_storage.erase(pending_for_storage.begin());
@@ -220,6 +539,47 @@ public:
                                        error_override);
     }
 
+    void process_storage_address(StorageModel::StorageFileAddress const& address)
+    {
+        try
+        {
+            if (address.duplicate_count > 1)
+                writeln_node("storage found a duplicate: " + address.uri);
+            else
+                writeln_node("storage got new data: " + address.uri);
+
+            beltpp::on_failure guard([this, &address]
+            {
+                storage_deletes.push_back(address.uri);
+            });
+            process_storage_done(address.uri, string());
+
+            guard.dismiss();
+        }
+        catch (std::logic_error const& ex)
+        {
+            throw;
+        }
+        catch (std::exception const& ex)
+        {
+            writeln_node("library addition exception: " + std::string(ex.what()));
+        }
+        catch (...)
+        {
+            throw;
+        }
+    }
+
+    //  the results sent to storage and not acknowledged yet
+    uint64_t storage_in_flight() const
+    {
+        return uint64_t(std::count_if(pending_for_storage.begin(), pending_for_storage.end(),
+                                      [](InternalModel::ProcessMediaCheckResult const& item)
+                                      {
+                                          return item.count != 0;
+                                      }));
+    }
+
     void process_check_done_wrapper(InternalModel::ProcessMediaCheckResult&& progress_info,
                                     string const& uri,
                                     string const& error_override)
@@ -256,17 +616,24 @@ public:
                 if (false == error_override.empty())
                     problem.reason = error_override;
                 writeln_node(join_path(path).first + ": " + problem.reason);
-                log->log.push_back(packet(std::move(problem)));
+                log.push(packet(std::move(problem)));
             }
             else
             {
                 AdminModel::CheckMediaResult done;
                 done.path = path;
                 writeln_node(join_path(path).first + ": done");
-                log->log.push_back(packet(std::move(done)));
+                log.push(packet(std::move(done)));
             }
 
             library.process_index_done(path, type_descriptions);
+
+            if (detected)
+                trace::finish(join_path(path).first, "done");
+            else if (error_override.empty())
+                trace::finish(join_path(path).first, "failed", "was not able to detect any media type");
+            else
+                trace::finish(join_path(path).first, "failed", error_override);
         }
         else
         {
@@ -286,13 +653,15 @@ public:
                 if (false == error_override.empty())
                     problem.reason = error_override;
                 writeln_node(join_path(path).first + ": " + problem.reason);
-                log->log.push_back(packet(std::move(problem)));
+                log.push(packet(std::move(problem)));
             });
 
             library.process_check_done_part(std::move(progress_info), uri);
 
             guard.dismiss();
 
+            trace::instant(join_path(path).first, "library_add", uri);
+
             if (uri.empty())
             {
                 AdminModel::CheckMediaWarning problem;
@@ -302,7 +671,7 @@ public:
                     problem.reason = error_override;
 
                 writeln_node(join_path(path).first + ": " + problem.reason);
-                log->log.push_back(packet(std::move(problem)));
+                log.push(packet(std::move(problem)));
             }
             else
             {
@@ -371,13 +740,23 @@ admin_server::admin_server(ip_address const& bind_to_address,
                            filesystem::path const& fs_admin,
                            meshpp::private_key const& pv_key,
                            ilog* plogger,
-                           beltpp::direct_channel& channel)
+                           beltpp::direct_channel& channel,
+                           spsc_ring<packet>& worker_results,
+                           uint64_t index_concurrency,
+                           uint64_t log_retention,
+                           chrono::steady_clock::duration const& group_commit_window,
+                           uint64_t batch_size)
     : m_pimpl(new detail::admin_server_internals(bind_to_address,
                                                  fs_library,
                                                  fs_admin,
                                                  pv_key,
                                                  plogger,
-                                                 channel))
+                                                 channel,
+                                                 worker_results,
+                                                 index_concurrency,
+                                                 log_retention,
+                                                 group_commit_window,
+                                                 batch_size))
 {
 
 }
@@ -393,11 +772,32 @@ void admin_server::run(bool& stop_check)
 {
     stop_check = false;
 
+    if (m_pimpl->watch_changed)
+    {
+        InternalModel::WatchRoots roots;
+        for (auto const& item : m_pimpl->watch.as_const()->items)
+            roots.roots.push_back(item.path);
+
+        m_pimpl->ptr_direct_stream->send(worker_peerid, packet(std::move(roots)));
+        m_pimpl->watch_changed = false;
+    }
+
+    m_pimpl->send_storage_batches();
+
+    if (m_pimpl->storage_credits)
+    {
+        InternalModel::StorageCredit credit;
+        credit.count = m_pimpl->storage_credits;
+
+        m_pimpl->ptr_direct_stream->send(worker_peerid, packet(std::move(credit)));
+        m_pimpl->storage_credits = 0;
+    }
     {
         auto items = m_pimpl->library.process_check();
         for (auto&& item : items)
         {
             m_pimpl->writeln_node(join_path(item.path).first + " processing for check");
+            trace::stage(join_path(item.path).first, "check_queued");
             m_pimpl->ptr_direct_stream->send(worker_peerid, packet(std::move(item)));
         }
     }
@@ -406,6 +806,7 @@ void admin_server::run(bool& stop_check)
         for (auto&& path : paths_and_descs)
         {
             m_pimpl->writeln_node(join_path(path.first).first + " processing for index");
+            trace::stage(join_path(path.first).first, "index_queued");
             InternalModel::ProcessIndexRequest request;
             request.path = std::move(path.first);
             request.type_descriptions = path.second;
@@ -413,458 +814,667 @@ void admin_server::run(bool& stop_check)
         }
     }
 
-    auto wait_result = detail::wait_and_receive_one(m_pimpl->wait_result_info,
+    if (m_pimpl->batch.empty())
+    {
+        auto batch = detail::wait_and_receive_batch(m_pimpl->wait_result_info,
                                                     *m_pimpl->ptr_eh,
                                                     *m_pimpl->ptr_socket,
-                                                    m_pimpl->ptr_direct_stream.get());
+                                                    m_pimpl->ptr_direct_stream.get(),
+                                                    m_pimpl->batch_size);
+        for (auto& item : batch)
+            m_pimpl->batch.push_back(std::move(item));
+
+        //  the worker results come through the ring, which wakes the wait only
+        //  when it turns non empty, so it is emptied here every time
+        vector<packet> results;
+        m_pimpl->worker_results.pop_all(results);
+        for (auto& item : results)
+            m_pimpl->batch.push_back(detail::wait_result_item::on_demand_result(worker_peerid, std::move(item)));
+    }
 
-    if (wait_result.et == detail::wait_result_item::event)
+    //  the packets left after an exception are processed on the next run
+    while (false == m_pimpl->batch.empty())
     {
-        auto peerid = wait_result.peerid;
-        auto received_packet = std::move(wait_result.packet);
-
-        auto& stream = *m_pimpl->ptr_socket;
+        auto wait_result = std::move(m_pimpl->batch.front());
+        m_pimpl->batch.pop_front();
 
-        try
+        if (wait_result.et == detail::wait_result_item::event)
         {
-            beltpp::on_failure guard([this]{ m_pimpl->discard(); });
+            auto peerid = wait_result.peerid;
+            auto received_packet = std::move(wait_result.packet);
 
-            switch (received_packet.type())
-            {
-            case beltpp::stream_join::rtt:
-            {
-                m_pimpl->writeln_node("admin: joined: " + peerid);
-                break;
-            }
-            case beltpp::stream_drop::rtt:
-            {
-                m_pimpl->writeln_node("admin: dropped: " + peerid);
-                break;
-            }
-            case beltpp::stream_protocol_error::rtt:
-            {
-                beltpp::stream_protocol_error msg;
-                m_pimpl->writeln_node("admin: protocol error: " + peerid);
-                m_pimpl->writeln_node(msg.buffer);
-                stream.send(peerid, beltpp::packet(beltpp::stream_drop()));
+            auto& stream = *m_pimpl->ptr_socket;
 
-                break;
-            }
-            case beltpp::socket_open_refused::rtt:
-            {
-                beltpp::socket_open_refused msg;
-                std::move(received_packet).get(msg);
-                m_pimpl->writeln_node_warning(msg.reason + ", " + peerid);
-                break;
-            }
-            case beltpp::socket_open_error::rtt:
-            {
-                beltpp::socket_open_error msg;
-                std::move(received_packet).get(msg);
-                m_pimpl->writeln_node_warning(msg.reason + ", " + peerid);
-                break;
-            }
-            case IndexListGet::rtt:
-            {
-                stream.send(peerid, packet(m_pimpl->library.list_index(string())));
-                break;
-            }
-            case IndexGet::rtt:
+            auto started = chrono::steady_clock::now();
+            metrics::route const* proute = m_pimpl->route(received_packet.type());
+
+            try
             {
-                IndexGet request;
-                std::move(received_packet).get(request);
+                beltpp::on_failure guard([this]{ m_pimpl->discard(); });
 
-                LibraryIndex response;
-                auto temp = m_pimpl->library.list_index(request.sha256sum);
+                switch (received_packet.type())
+                {
+                case beltpp::stream_join::rtt:
+                {
+                    m_pimpl->writeln_node("admin: joined: " + peerid);
+                    break;
+                }
+                case beltpp::stream_drop::rtt:
+                {
+                    m_pimpl->writeln_node("admin: dropped: " + peerid);
+                    break;
+                }
+                case beltpp::stream_protocol_error::rtt:
+                {
+                    beltpp::stream_protocol_error msg;
+                    m_pimpl->writeln_node("admin: protocol error: " + peerid);
+                    m_pimpl->writeln_node(msg.buffer);
+                    stream.send(peerid, beltpp::packet(beltpp::stream_drop()));
 
-                if (temp.list_index.empty())
-                    throw std::runtime_error("index entry not found: " + request.sha256sum);
+                    break;
+                }
+                case beltpp::socket_open_refused::rtt:
+                {
+                    beltpp::socket_open_refused msg;
+                    std::move(received_packet).get(msg);
+                    m_pimpl->writeln_node_warning(msg.reason + ", " + peerid);
+                    break;
+                }
+                case beltpp::socket_open_error::rtt:
+                {
+                    beltpp::socket_open_error msg;
+                    std::move(received_packet).get(msg);
+                    m_pimpl->writeln_node_warning(msg.reason + ", " + peerid);
+                    break;
+                }
+                case IndexListGet::rtt:
+                {
+                    stream.send(peerid, packet(m_pimpl->library.list_index(string())));
+                    break;
+                }
+                case IndexGet::rtt:
+                {
+                    IndexGet request;
+                    std::move(received_packet).get(request);
 
-                response = temp.list_index.begin()->second;
+                    LibraryIndex response;
+                    auto temp = m_pimpl->library.list_index(request.sha256sum);
 
-                stream.send(peerid, packet(std::move(response)));
-                break;
-            }
-            case IndexDelete::rtt:
-            {
-                IndexDelete request;
-                std::move(received_packet).get(request);
+                    if (temp.list_index.empty())
+                        throw std::runtime_error("index entry not found: " + request.sha256sum);
 
-                auto uris = m_pimpl->library.delete_index(request.sha256sum);
-                stream.send(peerid, packet(LibraryIndex()));
+                    response = temp.list_index.begin()->second;
 
-                for (auto const& uri : uris)
+                    stream.send(peerid, packet(std::move(response)));
+                    break;
+                }
+                case IndexDelete::rtt:
                 {
-                    StorageModel::StorageFileDelete storage_request;
-                    storage_request.uri = uri;
-                    m_pimpl->ptr_direct_stream->send(storage_peerid, packet(std::move(storage_request)));
+                    IndexDelete request;
+                    std::move(received_packet).get(request);
+
+                    auto uris = m_pimpl->library.delete_index(request.sha256sum);
+                    stream.send(peerid, packet(LibraryIndex()));
+
+                    m_pimpl->storage_deletes.insert(m_pimpl->storage_deletes.end(), uris.begin(), uris.end());
+
+                    break;
                 }
+                case LibraryGet::rtt:
+                {
+                    LibraryGet request;
+                    std::move(received_packet).get(request);
 
-                break;
-            }
-            case LibraryGet::rtt:
-            {
-                LibraryGet request;
-                std::move(received_packet).get(request);
+                    auto library_result = m_pimpl->library.list(request.path);
+                
+                    detail::fill_with_fs(library_result, request.path);
+
+                    stream.send(peerid, packet(std::move(library_result)));
+                    break;
+                }
+                case LibraryPut::rtt:
+                {
+                    LibraryPut request;
+                    std::move(received_packet).get(request);
 
-                auto library_result = m_pimpl->library.list(request.path);
+                    if (false == request.path.empty())
+                    {
+                        auto path_copy = request.path;
+                        auto str_path = join_path(request.path).first;
+
+                        unordered_set<AdminModel::MediaTypeDescriptionVariant> type_descriptions;
+                        for (auto const& type_description : request.type_descriptions)
+                            type_descriptions.insert(type_description);
+
+                        uint64_t priority = request.priority ? *request.priority : default_priority;
+
+                        if (m_pimpl->library.index(std::move(path_copy), std::move(type_descriptions), priority))
+                        {
+                            m_pimpl->writeln_node(str_path + " scheduling for index");
+                            trace::stage(str_path, "pending_for_index");
+                        }
+                        else
+                        {
+                            m_pimpl->writeln_node(join_path(path_copy).first + " already scheduled for index");
+                            CheckMediaError not_accepted;
+                            not_accepted.path = request.path;
+                            not_accepted.reason = "already scheduled for index";
+                            m_pimpl->log.push(packet(std::move(not_accepted)));
+                        }
+
+                        request.path.pop_back();
+                    }
+
+                    auto library_result = m_pimpl->library.list(request.path);
                 
-                detail::fill_with_fs(library_result, request.path);
+                    detail::fill_with_fs(library_result, request.path);
 
-                stream.send(peerid, packet(std::move(library_result)));
-                break;
-            }
-            case LibraryPut::rtt:
-            {
-                LibraryPut request;
-                std::move(received_packet).get(request);
+                    stream.send(peerid, packet(std::move(library_result)));
 
-                if (false == request.path.empty())
+                    break;
+                }
+                case LibraryDelete::rtt:
                 {
-                    auto path_copy = request.path;
-                    auto str_path = join_path(request.path).first;
+                    LibraryDelete request;
+                    std::move(received_packet).get(request);
 
-                    unordered_set<AdminModel::MediaTypeDescriptionVariant> type_descriptions;
-                    for (auto const& type_description : request.type_descriptions)
-                        type_descriptions.insert(type_description);
+                    vector<string> uris;
 
-                    if (m_pimpl->library.index(std::move(path_copy), std::move(type_descriptions)))
-                        m_pimpl->writeln_node(str_path + " scheduling for index");
-                    else
+                    if (false == request.path.empty())
                     {
-                        m_pimpl->writeln_node(join_path(path_copy).first + " already scheduled for index");
-                        CheckMediaError not_accepted;
-                        not_accepted.path = request.path;
-                        not_accepted.reason = "already scheduled for index";
-                        m_pimpl->log->log.push_back(packet(std::move(not_accepted)));
+                        uris = m_pimpl->library.delete_library(request.path);
+                        request.path.pop_back();
                     }
 
-                    request.path.pop_back();
-                }
-
-                auto library_result = m_pimpl->library.list(request.path);
+                    auto library_result = m_pimpl->library.list(request.path);
                 
-                detail::fill_with_fs(library_result, request.path);
+                    detail::fill_with_fs(library_result, request.path);
 
-                stream.send(peerid, packet(std::move(library_result)));
+                    stream.send(peerid, packet(std::move(library_result)));
 
-                break;
-            }
-            case LibraryDelete::rtt:
-            {
-                LibraryDelete request;
-                std::move(received_packet).get(request);
+                    m_pimpl->storage_deletes.insert(m_pimpl->storage_deletes.end(), uris.begin(), uris.end());
 
-                vector<string> uris;
+                    break;
+                }
+                case LogGet::rtt:
+                {
+                    LogGet request;
+                    std::move(received_packet).get(request);
 
-                if (false == request.path.empty())
+                    stream.send(peerid, packet(m_pimpl->log.get(request.since ? *request.since : 0,
+                                                                request.limit ? *request.limit : log_get_default_limit)));
+
+                    break;
+                }
+                case LogDelete::rtt:
                 {
-                    uris = m_pimpl->library.delete_library(request.path);
-                    request.path.pop_back();
+                    LogDelete request;
+                    std::move(received_packet).get(request);
+
+                    m_pimpl->log.erase(request.count);
+                    stream.send(peerid, packet(m_pimpl->log.get(0, log_get_default_limit)));
+
+                    break;
                 }
+                case QueueGet::rtt:
+                {
+                    auto queue_status = m_pimpl->library.queue();
+                    queue_status.storage_in_flight = m_pimpl->storage_in_flight();
+                    if (false == m_pimpl->transcoding.empty())
+                    {
+                        queue_status.transcoding = vector<TranscodeStatus>();
+                        for (auto const& item : m_pimpl->transcoding)
+                            queue_status.transcoding->push_back(item.second);
+                    }
 
-                auto library_result = m_pimpl->library.list(request.path);
-                
-                detail::fill_with_fs(library_result, request.path);
+                    stream.send(peerid, packet(std::move(queue_status)));
 
-                stream.send(peerid, packet(std::move(library_result)));
+                    break;
+                }
+                case WatchGet::rtt:
+                {
+                    stream.send(peerid, packet(*m_pimpl->watch.as_const()));
 
-                for (auto const& uri : uris)
+                    break;
+                }
+                case WatchPut::rtt:
                 {
-                    StorageModel::StorageFileDelete storage_request;
-                    storage_request.uri = uri;
-                    m_pimpl->ptr_direct_stream->send(storage_peerid, packet(std::move(storage_request)));
+                    WatchPut request;
+                    std::move(received_packet).get(request);
+
+                    if (false == filesystem::is_directory(check_path(request.path).first))
+                        throw std::runtime_error(join_path(request.path).first + " is not a directory");
+
+                    auto& items = m_pimpl->watch->items;
+                    auto it = std::find_if(items.begin(), items.end(), [&request](WatchItem const& item)
+                    {
+                        return item.path == request.path;
+                    });
+                    if (it == items.end())
+                        it = items.insert(items.end(), WatchItem());
+
+                    it->path = std::move(request.path);
+                    it->type_descriptions = std::move(request.type_descriptions);
+
+                    m_pimpl->writeln_node(join_path(it->path).first + " watching");
+                    m_pimpl->watch_changed = true;
+
+                    stream.send(peerid, packet(*m_pimpl->watch.as_const()));
+
+                    break;
                 }
+                case WatchDelete::rtt:
+                {
+                    WatchDelete request;
+                    std::move(received_packet).get(request);
 
-                break;
-            }
-            case LogGet::rtt:
-            {
-                stream.send(peerid, packet(*m_pimpl->log));
+                    auto& items = m_pimpl->watch->items;
+                    auto it = std::find_if(items.begin(), items.end(), [&request](WatchItem const& item)
+                    {
+                        return item.path == request.path;
+                    });
+                    if (it != items.end())
+                    {
+                        items.erase(it);
 
-                break;
-            }
-            case LogDelete::rtt:
-            {
-                LogDelete request;
-                std::move(received_packet).get(request);
+                        m_pimpl->writeln_node(join_path(request.path).first + " not watching");
+                        m_pimpl->watch_changed = true;
+                    }
 
-                auto& log = m_pimpl->log->log;
-                if (request.count > log.size())
-                    request.count = log.size();
+                    stream.send(peerid, packet(*m_pimpl->watch.as_const()));
 
-                log.erase(log.begin(), log.begin() + request.count);
-                stream.send(peerid, packet(*m_pimpl->log));
+                    break;
+                }
+                case StorageAuthorization::rtt:
+                {
+                    StorageAuthorization request;
+                    std::move(received_packet).get(request);
 
-                break;
-            }
-            case StorageAuthorization::rtt:
-            {
-                StorageAuthorization request;
-                std::move(received_packet).get(request);
+                    request.time_point.tm = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+
+                    SignedStorageAuthorization response;
+                    response.token = std::move(request);
+                    response.authorization.address = m_pimpl->pv_key.get_public_key().to_string();
+                    response.authorization.signature = m_pimpl->pv_key.sign(response.token.to_string()).base58;
+
+                    stream.send(peerid, packet(std::move(response)));
 
-                request.time_point.tm = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+                    break;
+                }
+                default:
+                {
+                    m_pimpl->writeln_node("peer: " + peerid);
+                    m_pimpl->writeln_node("admin can't handle: " + received_packet.to_string());
 
-                SignedStorageAuthorization response;
-                response.token = std::move(request);
-                response.authorization.address = m_pimpl->pv_key.get_public_key().to_string();
-                response.authorization.signature = m_pimpl->pv_key.sign(response.token.to_string()).base58;
+                    break;
+                }
+                }   // switch received_packet.type()
 
-                stream.send(peerid, packet(std::move(response)));
+                m_pimpl->save();
+                guard.dismiss();
+                if (false == m_pimpl->commit_postponed())
+                    m_pimpl->commit();
 
-                break;
+                if (proute)
+                    proute->observe(chrono::steady_clock::now() - started);
             }
-            default:
+            catch (std::exception const& e)
             {
-                m_pimpl->writeln_node("peer: " + peerid);
-                m_pimpl->writeln_node("admin can't handle: " + received_packet.to_string());
-
-                break;
+                RemoteError msg;
+                msg.message = e.what();
+                stream.send(peerid, beltpp::packet(msg));
+                throw;
+            }
+            catch (...)
+            {
+                RemoteError msg;
+                msg.message = "unknown exception";
+                stream.send(peerid, beltpp::packet(msg));
+                throw;
             }
-            }   // switch received_packet.type()
-
-            m_pimpl->save();
-            guard.dismiss();
-            m_pimpl->commit();
         }
-        catch (std::exception const& e)
+        else if (wait_result.et == detail::wait_result_item::timer)
         {
-            RemoteError msg;
-            msg.message = e.what();
-            stream.send(peerid, beltpp::packet(msg));
-            throw;
+            if (m_pimpl->commit_pending)
+                m_pimpl->commit();
+
+            auto now = chrono::steady_clock::now();
+            if (now - m_pimpl->last_timer_action >= event_timer_period)
+            {
+                m_pimpl->ptr_socket->timer_action();
+                m_pimpl->report_statistics(now - m_pimpl->last_timer_action);
+                m_pimpl->update_queue_metrics();
+                m_pimpl->last_timer_action = now;
+            }
         }
-        catch (...)
+        else if (m_pimpl->ptr_direct_stream && wait_result.et == detail::wait_result_item::on_demand)
         {
-            RemoteError msg;
-            msg.message = "unknown exception";
-            stream.send(peerid, beltpp::packet(msg));
-            throw;
-        }
-    }
-    else if (wait_result.et == detail::wait_result_item::timer)
-    {
-        m_pimpl->ptr_socket->timer_action();
-    }
-    else if (m_pimpl->ptr_direct_stream && wait_result.et == detail::wait_result_item::on_demand)
-    {
-        auto peerid = wait_result.peerid;
-        auto received_packet = std::move(wait_result.packet);
+            auto peerid = wait_result.peerid;
+            auto received_packet = std::move(wait_result.packet);
 
-        beltpp::on_failure guard([this]{ m_pimpl->discard(); });
-
-        if (peerid == worker_peerid)
-        switch (received_packet.type())
-        {
-        case InternalModel::ProcessIndexResult::rtt:
-        {
-            InternalModel::ProcessIndexResult request;
-            received_packet.get(request);
-
-            AdminModel::IndexListResponse index_list = m_pimpl->library.list_index(request.sha256sum);
-            auto type_descriptions_temp = request.type_descriptions;
-            for (auto const& existing :
-                 index_list.list_index[request.sha256sum].type_definitions)
-                type_descriptions_temp.erase(existing.type_description);
-
-            if (type_descriptions_temp.empty())
-            {
-                m_pimpl->writeln_node(join_path(request.path).first + ": with hash " +
-                                      request.sha256sum + " is already indexed");
-
-                // with below call, if the path does not yet exist in the library
-                // we will add the path to library and bind to existing index
-                InternalModel::ProcessMediaCheckResult dummy_progress_item;
-                dummy_progress_item.path = request.path;
-                m_pimpl->library.add(std::move(dummy_progress_item),
-                                     string(),
-                                     request.sha256sum);
-                m_pimpl->library.process_index_done(request.path, request.type_descriptions);
+            beltpp::on_failure guard([this]{ m_pimpl->discard(); });
 
-                CheckMediaResult done;
-                done.path = request.path;
-                m_pimpl->log->log.push_back(packet(std::move(done)));
-            }
-            else
+            if (peerid == worker_peerid)
+            switch (received_packet.type())
             {
-                m_pimpl->library.process_index_update(request.path,
-                                                      request.type_descriptions,
-                                                      type_descriptions_temp);
-                request.type_descriptions = std::move(type_descriptions_temp);
-                type_descriptions_temp =
-                        m_pimpl->library.process_index_store_hash(request.path,
-                                                                  request.type_descriptions,
-                                                                  request.sha256sum);
-
-                bool can_continue_with_check = false;
-                auto existing_info = m_pimpl->library.info(request.path);
-                if (existing_info.type() == FileItem::rtt)
-                {
-                    FileItem file_item;
-                    std::move(existing_info).get(file_item);
+            case InternalModel::ProcessIndexResult::rtt:
+            {
+                InternalModel::ProcessIndexResult request;
+                received_packet.get(request);
 
-                    if (!file_item.checksum)
-                        throw std::logic_error("case InternalModel::ProcessIndexResult::rtt: !file_item.checksum");
+                string item = join_path(request.path).first;
 
-                    if (*file_item.checksum == request.sha256sum)
-                        can_continue_with_check = true;
-                }
-                else if (existing_info.empty())
-                    can_continue_with_check = true;
-                
-                if (type_descriptions_temp.empty())
-                {
-                    m_pimpl->writeln_node(join_path(request.path).first + ": with hash " +
-                                          request.sha256sum +
-                                          " is already indexed and scheduled for media check");
+                m_pimpl->replace_watched(request.path, request.sha256sum);
 
-                    m_pimpl->library.process_index_done(request.path, request.type_descriptions);
+                AdminModel::IndexListResponse index_list = m_pimpl->library.list_index(request.sha256sum);
+                auto type_descriptions_temp = request.type_descriptions;
+                for (auto const& existing :
+                     index_list.list_index[request.sha256sum].type_definitions)
+                    type_descriptions_temp.erase(existing.type_description);
 
-                    CheckMediaError not_accepted;
-                    not_accepted.path = request.path;
-                    not_accepted.reason = "is already indexed and scheduled for media check";
-                    m_pimpl->log->log.push_back(packet(std::move(not_accepted)));
-                }
-                else if (false == can_continue_with_check)
+                if (type_descriptions_temp.empty())
                 {
                     m_pimpl->writeln_node(join_path(request.path).first + ": with hash " +
-                                          request.sha256sum +
-                                          " cannot be checked, because there is already a different file or a directory");
+                                          request.sha256sum + " is already indexed");
+
+                    // with below call, if the path does not yet exist in the library
+                    // we will add the path to library and bind to existing index
+                    InternalModel::ProcessMediaCheckResult dummy_progress_item;
+                    dummy_progress_item.path = request.path;
+                    m_pimpl->library.add(std::move(dummy_progress_item),
+                                         string(),
+                                         request.sha256sum);
                     m_pimpl->library.process_index_done(request.path, request.type_descriptions);
 
-                    CheckMediaError not_accepted;
-                    not_accepted.path = request.path;
-                    not_accepted.reason = "please delete this path first";
-                    m_pimpl->log->log.push_back(packet(std::move(not_accepted)));
+                    CheckMediaResult done;
+                    done.path = request.path;
+                    m_pimpl->log.push(packet(std::move(done)));
+
+                    trace::finish(item, "done", "already indexed");
                 }
                 else
                 {
-                    m_pimpl->writeln_node(join_path(request.path).first +
-                                          ": with hash "  + request.sha256sum +
-                                          " scheduling for check");
-
                     m_pimpl->library.process_index_update(request.path,
                                                           request.type_descriptions,
                                                           type_descriptions_temp);
                     request.type_descriptions = std::move(type_descriptions_temp);
+                    type_descriptions_temp =
+                            m_pimpl->library.process_index_store_hash(request.path,
+                                                                      request.type_descriptions,
+                                                                      request.sha256sum);
+
+                    bool can_continue_with_check = false;
+                    auto existing_info = m_pimpl->library.info(request.path);
+                    if (existing_info.type() == FileItem::rtt)
+                    {
+                        FileItem file_item;
+                        std::move(existing_info).get(file_item);
+
+                        if (!file_item.checksum)
+                            throw std::logic_error("case InternalModel::ProcessIndexResult::rtt: !file_item.checksum");
 
-                    if (false == m_pimpl->library.check(std::move(request.path), request.type_descriptions))
+                        if (*file_item.checksum == request.sha256sum)
+                            can_continue_with_check = true;
+                    }
+                    else if (existing_info.empty())
+                        can_continue_with_check = true;
+                
+                    if (type_descriptions_temp.empty())
                     {
-                        m_pimpl->writeln_node("\tis already scheduled");
+                        m_pimpl->writeln_node(join_path(request.path).first + ": with hash " +
+                                              request.sha256sum +
+                                              " is already indexed and scheduled for media check");
 
                         m_pimpl->library.process_index_done(request.path, request.type_descriptions);
 
                         CheckMediaError not_accepted;
                         not_accepted.path = request.path;
-                        not_accepted.reason = "already scheduled for media check";
-                        m_pimpl->log->log.push_back(packet(std::move(not_accepted)));
+                        not_accepted.reason = "is already indexed and scheduled for media check";
+                        trace::finish(item, "failed", not_accepted.reason);
+                        m_pimpl->log.push(packet(std::move(not_accepted)));
+                    }
+                    else if (false == can_continue_with_check)
+                    {
+                        m_pimpl->writeln_node(join_path(request.path).first + ": with hash " +
+                                              request.sha256sum +
+                                              " cannot be checked, because there is already a different file or a directory");
+                        m_pimpl->library.process_index_done(request.path, request.type_descriptions);
+
+                        CheckMediaError not_accepted;
+                        not_accepted.path = request.path;
+                        not_accepted.reason = "please delete this path first";
+                        trace::finish(item, "failed", not_accepted.reason);
+                        m_pimpl->log.push(packet(std::move(not_accepted)));
+                    }
+                    else
+                    {
+                        m_pimpl->writeln_node(join_path(request.path).first +
+                                              ": with hash "  + request.sha256sum +
+                                              " scheduling for check");
+
+                        m_pimpl->library.process_index_update(request.path,
+                                                              request.type_descriptions,
+                                                              type_descriptions_temp);
+                        request.type_descriptions = std::move(type_descriptions_temp);
+
+                        if (false == m_pimpl->library.check(std::move(request.path), request.type_descriptions))
+                        {
+                            m_pimpl->writeln_node("\tis already scheduled");
+
+                            m_pimpl->library.process_index_done(request.path, request.type_descriptions);
+
+                            CheckMediaError not_accepted;
+                            not_accepted.path = request.path;
+                            not_accepted.reason = "already scheduled for media check";
+                            trace::finish(item, "failed", not_accepted.reason);
+                            m_pimpl->log.push(packet(std::move(not_accepted)));
+                        }
+                        else
+                            trace::stage(item, "pending_for_media_check");
                     }
                 }
+
+                break;
             }
+            case InternalModel::ProcessIndexError::rtt:
+            {
+                InternalModel::ProcessIndexError request;
+                std::move(received_packet).get(request);
 
-            break;
-        }
-        case InternalModel::ProcessIndexError::rtt:
-        {
-            InternalModel::ProcessIndexError request;
-            std::move(received_packet).get(request);
+                CheckMediaError log;
+                log.path = request.path;
+                log.reason = request.reason;
 
-            CheckMediaError log;
-            log.path = request.path;
-            log.reason = request.reason;
+                m_pimpl->library.process_index_done(request.path, request.type_descriptions);
+                m_pimpl->watch_replacing.erase(join_path(request.path).first);
 
-            m_pimpl->library.process_index_done(request.path, request.type_descriptions);
+                m_pimpl->writeln_node(join_path(request.path).first + ": " + request.reason);
+                m_pimpl->log.push(packet(std::move(log)));
 
-            m_pimpl->writeln_node(join_path(request.path).first + ": " + request.reason);
-            m_pimpl->log->log.push_back(packet(std::move(log)));
-            break;
-        }
-        case InternalModel::ProcessMediaCheckResult::rtt:
-        {
-            InternalModel::ProcessMediaCheckResult request;
-            std::move(received_packet).get(request);
+                trace::finish(join_path(request.path).first, "failed", request.reason);
+                break;
+            }
+            case InternalModel::ProcessMediaCheckResult::rtt:
+            {
+                InternalModel::ProcessMediaCheckResult request;
+                std::move(received_packet).get(request);
 
-            if (request.count && request.data_or_file.empty())
-                throw std::logic_error("request.count && request.data_or_file.empty()");
+                if (request.count && request.data_or_file.empty())
+                    throw std::logic_error("request.count && request.data_or_file.empty()");
 
-            m_pimpl->writeln_node(join_path(request.path).first + " got some checked data");
-            m_pimpl->process_storage(std::move(request));
+                if (0 == request.count)
+                    m_pimpl->transcoding.erase(join_path(request.path).first);
 
-            break;
-        }
-        }
-        else if (peerid == storage_peerid)
-        switch (received_packet.type())
-        {
-        case StorageModel::StorageFileAddress::rtt:
-        {
-            try
+                m_pimpl->writeln_node(join_path(request.path).first + " got some checked data");
+                m_pimpl->process_storage(std::move(request));
+
+                break;
+            }
+            case InternalModel::ProcessMediaCheckWarning::rtt:
             {
-                StorageModel::StorageFileAddress request;
-                received_packet.get(request);
+                InternalModel::ProcessMediaCheckWarning request;
+                std::move(received_packet).get(request);
 
-                if (request.duplicate_count > 1)
-                    m_pimpl->writeln_node("storage found a duplicate: " + request.uri);
-                else
-                    m_pimpl->writeln_node("storage got new data: " + request.uri);
+                CheckMediaWarning log;
+                log.path = request.path;
+                log.reason = request.reason;
+
+                m_pimpl->writeln_node(join_path(request.path).first + ": " + request.reason);
+                m_pimpl->log.push(packet(std::move(log)));
+
+                trace::instant(join_path(request.path).first, "warning", request.reason);
+                break;
+            }
+            case InternalModel::ProcessMediaCheckProgress::rtt:
+            {
+                InternalModel::ProcessMediaCheckProgress request;
+                std::move(received_packet).get(request);
 
-                beltpp::on_failure guard([this, &request]
+                TranscodeStatus* pstatus;
+                request.status->get(pstatus);
+
+                m_pimpl->transcoding[join_path(pstatus->path).first] = std::move(*pstatus);
+
+                break;
+            }
+            case InternalModel::WatchChanges::rtt:
+            {
+                InternalModel::WatchChanges request;
+                std::move(received_packet).get(request);
+
+                for (auto& path : request.paths)
                 {
-                    StorageModel::StorageFileDelete file_delete;
-                    file_delete.uri = request.uri;
+                    //  the deepest watched directory defines the type descriptions
+                    WatchItem const* pwatch_item = nullptr;
+                    for (auto const& item : m_pimpl->watch.as_const()->items)
+                    {
+                        if (item.path.size() < path.size() &&
+                            std::equal(item.path.begin(), item.path.end(), path.begin()) &&
+                            (nullptr == pwatch_item || pwatch_item->path.size() < item.path.size()))
+                            pwatch_item = &item;
+                    }
 
-                    m_pimpl->ptr_direct_stream->send(storage_peerid, packet(std::move(file_delete)));
-                });
-                m_pimpl->process_storage_done(request.uri, string());
+                    if (nullptr == pwatch_item)
+                        continue;
 
-                guard.dismiss();
+                    auto str_path = join_path(path).first;
+
+                    unordered_set<AdminModel::MediaTypeDescriptionVariant> type_descriptions;
+                    for (auto const& type_description : pwatch_item->type_descriptions)
+                        type_descriptions.insert(type_description);
+
+                    bool existing = (m_pimpl->library.info(path).type() == FileItem::rtt);
+
+                    if (m_pimpl->library.index(std::move(path), std::move(type_descriptions), default_priority))
+                    {
+                        m_pimpl->writeln_node(str_path + " changed, scheduling for index");
+                        trace::stage(str_path, "pending_for_index");
+                        if (existing)
+                            m_pimpl->watch_replacing.insert(str_path);
+                    }
+                    else
+                        m_pimpl->writeln_node(str_path + " changed, already scheduled for index");
+                }
+
+                break;
+            }
             }
-            catch (std::logic_error const& ex)
+            else if (peerid == storage_peerid)
+            switch (received_packet.type())
             {
-                throw;
+            case StorageModel::StorageFileAddress::rtt:
+            {
+                StorageModel::StorageFileAddress request;
+                received_packet.get(request);
+
+                if (1 != m_pimpl->storage_responded())
+                    throw std::logic_error("case StorageModel::StorageFileAddress::rtt: 1 != storage_responded()");
+
+                m_pimpl->process_storage_address(request);
+
+                break;
             }
-            catch (std::exception const& ex)
+            case StorageModel::StorageFileAddressBatch::rtt:
             {
-                m_pimpl->writeln_node("library addition exception: " + std::string(ex.what()));
+                StorageModel::StorageFileAddressBatch request;
+                received_packet.get(request);
+
+                if (request.addresses.size() != m_pimpl->storage_responded())
+                    throw std::logic_error("case StorageModel::StorageFileAddressBatch::rtt: request.addresses.size() != storage_responded()");
+                if (request.errors.size() != request.addresses.size())
+                    throw std::logic_error("case StorageModel::StorageFileAddressBatch::rtt: request.errors.size() != request.addresses.size()");
+
+                for (size_t index = 0; index != request.addresses.size(); ++index)
+                {
+                    if (request.errors[index].empty())
+                        m_pimpl->process_storage_address(request.addresses[index]);
+                    else
+                        m_pimpl->process_storage_done(string(), request.errors[index]);
+                }
+
+                break;
             }
-            catch (...)
+            case StorageModel::StorageFileDeleted::rtt:
             {
-                throw;
+                StorageModel::StorageFileDeleted request;
+                received_packet.get(request);
+
+                if (0 == request.remaining_count)
+                    m_pimpl->writeln_node("storage deleted data: " + request.uri);
+                else
+                    m_pimpl->writeln_node("storage decremented refcount: " + request.uri + ", " + std::to_string(request.remaining_count - 1));
+
+                break;
             }
+            case StorageModel::StorageFileDeletedBatch::rtt:
+            {
+                StorageModel::StorageFileDeletedBatch request;
+                received_packet.get(request);
 
-            break;
-        }
-        case StorageModel::StorageFileDeleted::rtt:
-        {
-            StorageModel::StorageFileDeleted request;
-            received_packet.get(request);
+                if (0 != m_pimpl->storage_responded())
+                    throw std::logic_error("case StorageModel::StorageFileDeletedBatch::rtt: 0 != storage_responded()");
 
-            if (0 == request.remaining_count)
-                m_pimpl->writeln_node("storage deleted data: " + request.uri);
-            else
-                m_pimpl->writeln_node("storage decremented refcount: " + request.uri + ", " + std::to_string(request.remaining_count - 1));
+                for (auto const& deleted : request.deleted)
+                {
+                    if (0 == deleted.remaining_count)
+                        m_pimpl->writeln_node("storage deleted data: " + deleted.uri);
+                    else
+                        m_pimpl->writeln_node("storage decremented refcount: " + deleted.uri + ", " + std::to_string(deleted.remaining_count));
+                }
 
-            break;
-        }
-        case StorageModel::UriError::rtt:
-        {
-            throw std::logic_error("case StorageModel::UriError::rtt:");
-            //break;
-        }
-        case StorageModel::RemoteError::rtt:
-        {
-            StorageModel::RemoteError request;
-            received_packet.get(request);
+                if (false == request.missing.empty())
+                    throw std::logic_error("case StorageModel::StorageFileDeletedBatch::rtt: missing " + request.missing.front());
+
+                break;
+            }
+            case StorageModel::UriError::rtt:
+            {
+                throw std::logic_error("case StorageModel::UriError::rtt:");
+                //break;
+            }
+            case StorageModel::RemoteError::rtt:
+            {
+                StorageModel::RemoteError request;
+                received_packet.get(request);
 
-            m_pimpl->process_storage_done(string(), request.message);
+                //  the files that can't be stored come in StorageFileAddressBatch::errors,
+                //  this is the whole batch rolled back by storage
+                size_t count = m_pimpl->storage_responded();
+                if (0 == count)
+                    m_pimpl->writeln_node("storage failed to delete: " + request.message);
 
-            break;
-        }
-        }
+                for (size_t index = 0; index != count; ++index)
+                    m_pimpl->process_storage_done(string(), request.message);
 
-        m_pimpl->save();
-        guard.dismiss();
-        m_pimpl->commit();
+                break;
+            }
+            }
+
+            m_pimpl->save();
+            guard.dismiss();
+            if (false == m_pimpl->commit_postponed())
+                m_pimpl->commit();
+        }
     }
 }
 
@@ -1,15 +1,18 @@
 #pragma once
 
 #include "global.hpp"
+#include "spsc_ring.hpp"
 
 #include <belt.pp/isocket.hpp>
 #include <belt.pp/ilog.hpp>
+#include <belt.pp/packet.hpp>
 #include <belt.pp/direct_stream.hpp>
 #include <mesh.pp/cryptoutility.hpp>
 
 #include <boost/filesystem/path.hpp>
 
 #include <memory>
+#include <chrono>
 
 namespace cloudy
 {
@@ -26,7 +29,12 @@ public:
                  boost::filesystem::path const& fs_admin,
                  meshpp::private_key const& pv_key,
                  beltpp::ilog* plogger,
-                 beltpp::direct_channel& channel);
+                 beltpp::direct_channel& channel,
+                 spsc_ring<beltpp::packet>& worker_results,
+                 uint64_t index_concurrency,
+                 uint64_t log_retention,
+                 std::chrono::steady_clock::duration const& group_commit_window,
+                 uint64_t batch_size);
     admin_server(admin_server&& other) noexcept;
     ~admin_server();
 
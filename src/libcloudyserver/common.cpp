@@ -83,6 +83,22 @@ bool verify_storage_order(string const& storage_order_token,
     return true;
 }
 
+string sign_storage_order(meshpp::private_key const& pv_key,
+                          string const& file_uri,
+                          string const& session_id,
+                          uint64_t seconds)
+{
+    AdminModel::SignedStorageAuthorization signed_order;
+    signed_order.token.file_uri = file_uri;
+    signed_order.token.session_id = session_id;
+    signed_order.token.seconds = seconds;
+    signed_order.token.time_point.tm = chrono::system_clock::to_time_t(chrono::system_clock::now());
+    signed_order.authorization.address = pv_key.get_public_key().to_string();
+    signed_order.authorization.signature = pv_key.sign(signed_order.token.to_string()).base58;
+
+    return meshpp::to_base64(beltpp::packet(std::move(signed_order)).to_string(), false);
+}
+
 pair<string, string> join_path(vector<string> const& path)
 {
     string path_string;
@@ -211,6 +227,32 @@ wait_result_item wait_and_receive_one(wait_result& wait_result_info,
 
     return result;
 }
+
+std::vector<wait_result_item> wait_and_receive_batch(wait_result& wait_result_info,
+                                                     beltpp::event_handler& eh,
+                                                     beltpp::stream& event_stream,
+                                                     beltpp::stream* on_demand_stream,
+                                                     size_t max_count)
+{
+    std::vector<wait_result_item> result;
+
+    do
+    {
+        auto item = wait_and_receive_one(wait_result_info,
+                                         eh,
+                                         event_stream,
+                                         on_demand_stream);
+        if (item.et == wait_result_item::nothing)
+            break;
+
+        result.push_back(std::move(item));
+    }
+    while (result.size() < max_count &&
+           wait_result_info.m_wait_result != beltpp::event_handler::wait_result::nothing);
+
+    return result;
+}
+
 std::string dashboard()
 {
     return R"dashboard_here(
@@ -278,6 +320,7 @@ std::string dashboard()
         constructor() {
             this.requestInfo = new RequestInfo();
             this.log = [];
+            this.log_since = 0;
             this.autorefresh = 1;
             this.showlogdiv = true;
             
@@ -526,6 +569,8 @@ std::string dashboard()
 
                     if (log_response.rtt != 12)
                         throw log_response;
+
+                    Singleton.Dashboard().log_since = log_response.next;
                     
                     for (var log_entry of log_response.log) {
                         if (log_entry.rtt == 13)
@@ -560,18 +605,13 @@ std::string dashboard()
 
                         Singleton.Dashboard().log.push(string_log);
                     }
-                    
-                    var delete_log_request = new XMLHttpRequest();
-
-                    delete_log_request.open("DELETE", Singleton.Dashboard().requestInfo.admin + "/log/" + result.length, true);
-                    delete_log_request.send();
 
                     updateUI();
                 }
             }
         };
 
-        get_log_request.open("GET", Singleton.Dashboard().requestInfo.admin + "/log", true);
+        get_log_request.open("GET", Singleton.Dashboard().requestInfo.admin + "/log?since=" + Singleton.Dashboard().log_since, true);
         get_log_request.send();
         Singleton.Dashboard().waiting++;
     }
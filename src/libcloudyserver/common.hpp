@@ -5,7 +5,10 @@
 #include <belt.pp/isocket.hpp>
 #include <belt.pp/packet.hpp>
 
+#include <mesh.pp/cryptoutility.hpp>
+
 #include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
 
 #include <string>
 #include <chrono>
@@ -20,28 +23,133 @@ size_t const http_header_max_size = 64 * 1024;
 size_t const http_content_max_size = 10 * 1024 * 1024;
 
 size_t const storage_order_sign_instant_precision = 60;
+//  the smaller files are kept inside the storage map
+uint64_t const storage_inline_size_limit = 10 * 1024 * 1024;
 
 std::string const worker_peerid = "worker";
 std::string const admin_peerid = "admin";
 std::string const storage_peerid = "storage";
 
 std::chrono::steady_clock::duration const event_timer_period = std::chrono::seconds(15);
-
-beltpp::void_unique_ptr get_admin_putl();
-beltpp::void_unique_ptr get_storage_putl();
-beltpp::void_unique_ptr get_internal_putl();
-
-bool verify_storage_order(std::string const& storage_order_token,
-                          std::string& channel_address,
-                          std::string& file_uri,
-                          std::string& session_id,
-                          uint64_t& seconds,
-                          std::chrono::system_clock::time_point& tp);
+std::chrono::steady_clock::duration const watcher_timer_period = std::chrono::seconds(1);
+std::chrono::steady_clock::duration const watcher_settle_period = std::chrono::seconds(3);
+
+//  0 - background, 1 - normal, higher values are more urgent
+uint64_t const default_priority = 1;
+//  a pending media check gains one priority level per this period of waiting
+std::chrono::system_clock::duration const priority_aging_period = std::chrono::minutes(30);
+//  a file waiting for index can be overtaken by smaller files this many times
+uint64_t const index_fairness_cap = 16;
+
+//  milliseconds, the parts of a long input transcoded in parallel are at least this long
+uint64_t const transcode_part_duration = 60 * 1000;
+//  the transcode waits this long at most for the storage to catch up
+std::chrono::steady_clock::duration const storage_gate_timeout = std::chrono::seconds(60);
+//  the live progress of the transcode is sent to admin this often
+std::chrono::steady_clock::duration const transcode_progress_period = std::chrono::seconds(2);
+//  the worker stops taking results this long at most, while admin catches up with the ring
+std::chrono::steady_clock::duration const overflow_wait_period = std::chrono::seconds(1);
+
+//  the media items and the events per item kept for the lifecycle traces
+size_t const trace_item_limit = 1000;
+size_t const trace_event_limit = 10000;
+
+uint64_t const log_segment_size = 256;
+uint64_t const log_get_default_limit = 256;
+
+CLOUDYSERVERSHARED_EXPORT beltpp::void_unique_ptr get_admin_putl();
+CLOUDYSERVERSHARED_EXPORT beltpp::void_unique_ptr get_storage_putl();
+CLOUDYSERVERSHARED_EXPORT beltpp::void_unique_ptr get_internal_putl();
+
+CLOUDYSERVERSHARED_EXPORT bool verify_storage_order(std::string const& storage_order_token,
+                                                    std::string& channel_address,
+                                                    std::string& file_uri,
+                                                    std::string& session_id,
+                                                    uint64_t& seconds,
+                                                    std::chrono::system_clock::time_point& tp);
+//  the token verify_storage_order accepts, as admin gives it from /authorization
+CLOUDYSERVERSHARED_EXPORT std::string sign_storage_order(meshpp::private_key const& pv_key,
+                                                         std::string const& file_uri,
+                                                         std::string const& session_id,
+                                                         uint64_t seconds);
 
 
 std::pair<std::string, std::string> join_path(std::vector<std::string> const& path);
 std::pair<boost::filesystem::path, std::string> check_path(std::vector<std::string> const& path);
 
+class save_statistics
+{
+public:
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+};
+
+//  writes the file only if it was accessed for modification since the last save
+template <typename T_file_loader>
+class tracked_file_loader
+{
+public:
+    tracked_file_loader(boost::filesystem::path const& path)
+        : modified(false)
+        , saved(false)
+        , file_path(path)
+        , loader(path)
+    {}
+
+    auto operator -> () -> decltype(std::declval<T_file_loader&>().operator -> ())
+    {
+        modified = true;
+        return loader.operator -> ();
+    }
+
+    auto as_const() const -> decltype(std::declval<T_file_loader const&>().as_const())
+    {
+        return loader.as_const();
+    }
+
+    void save()
+    {
+        if (false == modified)
+            return;
+
+        loader.save();
+        modified = false;
+        saved = true;
+    }
+
+    void commit() noexcept
+    {
+        if (false == saved)
+            return;
+
+        loader.commit();
+        saved = false;
+
+        boost::system::error_code ec;
+        auto size = boost::filesystem::file_size(file_path, ec);
+        ++statistics.files;
+        if (!ec)
+            statistics.bytes += size;
+    }
+
+    void discard() noexcept
+    {
+        if (false == modified && false == saved)
+            return;
+
+        loader.discard();
+        modified = false;
+        saved = false;
+    }
+
+    save_statistics statistics;
+private:
+    bool modified;
+    bool saved;
+    boost::filesystem::path file_path;
+    T_file_loader loader;
+};
+
 namespace detail
 {
 
@@ -104,6 +212,13 @@ wait_result_item wait_and_receive_one(wait_result& wait_result_info,
                                              beltpp::event_handler& eh,
                                              beltpp::stream& event_stream,
                                              beltpp::stream* on_demand_stream);
+//  waits same as wait_and_receive_one, then takes the packets that are already received
+//  without waiting again, so that all of them are processed back to back
+std::vector<wait_result_item> wait_and_receive_batch(wait_result& wait_result_info,
+                                                     beltpp::event_handler& eh,
+                                                     beltpp::stream& event_stream,
+                                                     beltpp::stream* on_demand_stream,
+                                                     size_t max_count);
 
 std::string dashboard();
 }
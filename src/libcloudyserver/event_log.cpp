@@ -0,0 +1,217 @@
+#include "event_log.hpp"
+#include "common.hpp"
+#include "internal_model.hpp"
+
+#include <mesh.pp/fileutility.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <map>
+#include <algorithm>
+#include <string>
+#include <utility>
+
+namespace filesystem = boost::filesystem;
+using std::string;
+using std::unique_ptr;
+
+namespace cloudy
+{
+using namespace InternalModel;
+namespace detail
+{
+using segment_loader = tracked_file_loader<meshpp::file_loader<LogSegment,
+                                                               &LogSegment::from_string,
+                                                               &LogSegment::to_string>>;
+
+class event_log_internals
+{
+public:
+    event_log_internals(filesystem::path const& _path, uint64_t _retention)
+        : path(_path)
+        , retention(_retention)
+        , meta(_path / "meta.json")
+        , segments()
+        , statistics()
+        , removed_below(meta.as_const()->first / log_segment_size)
+    {}
+
+    filesystem::path segment_path(uint64_t index) const
+    {
+        return path / (std::to_string(index) + ".json");
+    }
+
+    segment_loader& segment(uint64_t index)
+    {
+        auto it = segments.find(index);
+        if (it == segments.end())
+        {
+            unique_ptr<segment_loader> ptr_segment(new segment_loader(segment_path(index)));
+            it = segments.insert(std::make_pair(index, std::move(ptr_segment))).first;
+        }
+
+        return *it->second;
+    }
+
+    void remove_dropped_segments() noexcept
+    {
+        uint64_t first_index = meta.as_const()->first / log_segment_size;
+        for (; removed_below < first_index; ++removed_below)
+        {
+            boost::system::error_code ec;
+            filesystem::remove(segment_path(removed_below), ec);
+        }
+    }
+
+    filesystem::path path;
+    uint64_t retention;
+    tracked_file_loader<meshpp::file_loader<LogMeta,
+                                            &LogMeta::from_string,
+                                            &LogMeta::to_string>> meta;
+    //  the last segment and the segments modified since the last commit
+    std::map<uint64_t, unique_ptr<segment_loader>> segments;
+    save_statistics statistics;
+    uint64_t removed_below;
+};
+}
+
+event_log::event_log(filesystem::path const& path, uint64_t retention)
+    : m_pimpl()
+{
+    if (0 == retention)
+        throw std::runtime_error("event_log::event_log: 0 == retention");
+
+    filesystem::create_directories(path);
+    m_pimpl.reset(new detail::event_log_internals(path, retention));
+}
+event_log::~event_log()
+{}
+
+void event_log::save()
+{
+    m_pimpl->meta.save();
+    for (auto& segment : m_pimpl->segments)
+        segment.second->save();
+}
+void event_log::commit() noexcept
+{
+    //  segments first, a crash in between leaves extra entries that the next push overwrites
+    for (auto& segment : m_pimpl->segments)
+    {
+        segment.second->commit();
+        m_pimpl->statistics.files += segment.second->statistics.files;
+        m_pimpl->statistics.bytes += segment.second->statistics.bytes;
+        segment.second->statistics = save_statistics();
+    }
+    m_pimpl->meta.commit();
+
+    uint64_t last_index = m_pimpl->meta.as_const()->next / log_segment_size;
+    auto it = m_pimpl->segments.begin();
+    while (it != m_pimpl->segments.end())
+    {
+        if (it->first != last_index)
+            it = m_pimpl->segments.erase(it);
+        else
+            ++it;
+    }
+
+    m_pimpl->remove_dropped_segments();
+}
+void event_log::discard() noexcept
+{
+    m_pimpl->meta.discard();
+    for (auto& segment : m_pimpl->segments)
+        segment.second->discard();
+    m_pimpl->segments.clear();
+}
+void event_log::clear()
+{
+    //  keep the numbering, so the readers polling with since don't go back
+    m_pimpl->meta->first = m_pimpl->meta.as_const()->next;
+}
+
+save_statistics event_log::statistics() const
+{
+    save_statistics result = m_pimpl->statistics;
+    result.files += m_pimpl->meta.statistics.files;
+    result.bytes += m_pimpl->meta.statistics.bytes;
+
+    return result;
+}
+
+void event_log::push(beltpp::packet&& entry)
+{
+    uint64_t sequence = m_pimpl->meta.as_const()->next;
+    auto& segment = m_pimpl->segment(sequence / log_segment_size);
+
+    auto& entries = segment->entries;
+    size_t offset = sequence % log_segment_size;
+    if (entries.size() > offset)
+        entries.erase(entries.begin() + offset, entries.end());
+
+    entries.push_back(std::move(entry));
+
+    auto& meta = m_pimpl->meta;
+    ++meta->next;
+    if (meta->next - meta->first > m_pimpl->retention)
+        meta->first = meta->next - m_pimpl->retention;
+}
+
+void event_log::erase(uint64_t count)
+{
+    auto const& meta = *m_pimpl->meta.as_const();
+    if (count > meta.next - meta.first)
+        count = meta.next - meta.first;
+
+    if (count)
+        m_pimpl->meta->first += count;
+}
+
+AdminModel::Log event_log::get(uint64_t since, uint64_t limit) const
+{
+    auto const& meta = *m_pimpl->meta.as_const();
+
+    AdminModel::Log result;
+    since = std::min(std::max(since, meta.first), meta.next);
+    uint64_t next = since;
+
+    while (next < meta.next && result.log.size() < limit)
+    {
+        uint64_t index = next / log_segment_size;
+        uint64_t offset = next % log_segment_size;
+
+        auto copy_entries = [&result, &next, &meta, offset, limit](LogSegment const& segment)
+        {
+            for (size_t entry_index = offset;
+                 entry_index < segment.entries.size() &&
+                 next < meta.next &&
+                 result.log.size() < limit;
+                 ++entry_index, ++next)
+                result.log.push_back(segment.entries[entry_index]);
+        };
+
+        uint64_t next_before = next;
+        auto it = m_pimpl->segments.find(index);
+        if (it != m_pimpl->segments.end())
+            copy_entries(*it->second->as_const());
+        else
+        {
+            meshpp::file_loader<LogSegment,
+                                &LogSegment::from_string,
+                                &LogSegment::to_string> segment(m_pimpl->segment_path(index));
+            copy_entries(*segment.as_const());
+        }
+
+        //  a missing or short segment, skip the lost entries
+        if (next == next_before ||
+            (next % log_segment_size != 0 && result.log.size() < limit && next < meta.next))
+            next = std::min(meta.next, (index + 1) * log_segment_size);
+    }
+
+    result.since = since;
+    result.next = next;
+
+    return result;
+}
+
+}
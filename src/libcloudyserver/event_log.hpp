@@ -0,0 +1,44 @@
+#pragma once
+
+#include "global.hpp"
+#include "admin_model.hpp"
+
+#include <belt.pp/packet.hpp>
+
+#include <boost/filesystem/path.hpp>
+
+#include <memory>
+
+namespace cloudy
+{
+
+namespace detail
+{
+class event_log_internals;
+}
+class save_statistics;
+
+//  the log entries are numbered sequentially and stored in fixed size segment files,
+//  so an append rewrites only the last segment and the oldest segments are dropped
+//  as whole files once the retention is exceeded
+class event_log
+{
+public:
+    event_log(boost::filesystem::path const& path, uint64_t retention);
+    ~event_log();
+
+    void save();
+    void commit() noexcept;
+    void discard() noexcept;
+    void clear();
+    save_statistics statistics() const;
+
+    void push(beltpp::packet&& entry);
+    //  drops the count oldest entries
+    void erase(uint64_t count);
+    AdminModel::Log get(uint64_t since, uint64_t limit) const;
+private:
+    std::unique_ptr<detail::event_log_internals> m_pimpl;
+};
+
+}
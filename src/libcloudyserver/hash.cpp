@@ -0,0 +1,132 @@
+#include "hash.hpp"
+
+extern "C"
+{
+#include <libavutil/sha.h>
+#include <libavutil/mem.h>
+}
+
+#include <boost/filesystem/fstream.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <exception>
+
+using std::string;
+using std::vector;
+namespace filesystem = boost::filesystem;
+
+namespace cloudy
+{
+namespace
+{
+//  meshpp::hash encodes the digest the same way
+string to_base58(unsigned char const* data, size_t size)
+{
+    char const* const alphabet = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+    size_t leading_zeros = 0;
+    while (leading_zeros != size && 0 == data[leading_zeros])
+        ++leading_zeros;
+
+    //  log(256) / log(58) is less than 1.38
+    vector<unsigned char> digits((size - leading_zeros) * 138 / 100 + 1, 0);
+    size_t digits_used = 0;
+
+    for (size_t index = leading_zeros; index != size; ++index)
+    {
+        uint32_t carry = data[index];
+        size_t digit = 0;
+        for (auto it = digits.rbegin();
+             (carry || digit < digits_used) && it != digits.rend();
+             ++it, ++digit)
+        {
+            carry += uint32_t(*it) << 8;
+            *it = static_cast<unsigned char>(carry % 58);
+            carry /= 58;
+        }
+        digits_used = digit;
+    }
+
+    string result(leading_zeros, '1');
+    for (size_t index = digits.size() - digits_used; index != digits.size(); ++index)
+        result += alphabet[digits[index]];
+
+    return result;
+}
+}
+
+stream_hash::stream_hash()
+    : context(av_sha_alloc())
+    , length(0)
+    , done(false)
+{
+    if (nullptr == context)
+        throw std::runtime_error("stream_hash: av_sha_alloc");
+    av_sha_init(context, 256);
+}
+
+stream_hash::~stream_hash()
+{
+    av_free(context);
+}
+
+void stream_hash::update(char const* data, size_t size)
+{
+    if (done)
+        throw std::logic_error("stream_hash::update: done");
+
+    length += size;
+
+    //  av_sha_update takes the length as unsigned int in the older ffmpeg
+    auto const* bytes = reinterpret_cast<uint8_t const*>(data);
+    while (size)
+    {
+        size_t count = std::min(size, stream_hash_block_size);
+        av_sha_update(context, bytes, static_cast<unsigned int>(count));
+        bytes += count;
+        size -= count;
+    }
+}
+
+uint64_t stream_hash::size() const
+{
+    return length;
+}
+
+string stream_hash::result()
+{
+    if (done)
+        throw std::logic_error("stream_hash::result: done");
+    done = true;
+
+    uint8_t digest[32];
+    av_sha_final(context, digest);
+
+    return to_base58(digest, sizeof(digest));
+}
+
+string hash_file(filesystem::path const& path, uint64_t& size)
+{
+    filesystem::ifstream fl(path, std::ios_base::binary);
+    if (!fl)
+        throw std::runtime_error("hash_file: cannot open " + path.string());
+
+    stream_hash hash;
+    vector<char> block(stream_hash_block_size);
+
+    while (fl)
+    {
+        fl.read(block.data(), std::streamsize(block.size()));
+        auto count = fl.gcount();
+        if (count > 0)
+            hash.update(block.data(), size_t(count));
+    }
+
+    if (fl.bad())
+        throw std::runtime_error("hash_file: cannot read " + path.string());
+
+    size = hash.size();
+    return hash.result();
+}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "global.hpp"
+
+#include <boost/filesystem/path.hpp>
+
+#include <string>
+
+struct AVSHA;
+
+namespace cloudy
+{
+//  incremental sha256 on libavutil, the result is formatted same as meshpp::hash
+//  so it can be computed over data that does not fit into memory
+class CLOUDYSERVERSHARED_EXPORT stream_hash
+{
+public:
+    stream_hash();
+    ~stream_hash();
+    stream_hash(stream_hash const&) = delete;
+    stream_hash& operator = (stream_hash const&) = delete;
+
+    void update(char const* data, size_t size);
+    uint64_t size() const;
+    //  the object cannot be updated anymore after this
+    std::string result();
+private:
+    AVSHA* context;
+    uint64_t length;
+    bool done;
+};
+
+size_t const stream_hash_block_size = 1024 * 1024;
+
+std::string hash_file(boost::filesystem::path const& path, uint64_t& size);
+}
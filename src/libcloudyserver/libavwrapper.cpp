@@ -2,10 +2,16 @@
 #include "admin_model.hpp"
 #include "internal_model.hpp"
 #include "worker.hpp"
+#include "hash.hpp"
+
+#include <belt.pp/scope_helper.hpp>
 
 #include <mesh.pp/cryptoutility.hpp>
+#include <mesh.pp/fileutility.hpp>
 
 #include <boost/filesystem/path.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
 
 //#include <iostream>
 
@@ -18,6 +24,8 @@ extern "C"
 #include <libavutil/timestamp.h>
 #include <libavutil/opt.h>
 #include <libavutil/display.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/samplefmt.h>
 #include <libavfilter/avfilter.h>
 #include <libavfilter/buffersink.h>
 #include <libavfilter/buffersrc.h>
@@ -30,11 +38,18 @@ extern "C"
 
 #include <cassert>
 #include <cmath>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <unordered_set>
+#include <deque>
 
 using std::string;
 using beltpp::packet;
 using std::vector;
 using std::unordered_map;
+using std::unordered_set;
 using std::pair;
 namespace filesystem = boost::filesystem;
 
@@ -149,7 +164,199 @@ format_context_ptr format_context_alloc_output(string const& filepath)
 
     return res;
 }
-format_context_ptr format_context_alloc_input(string const& filepath)
+int64_t timestamp_ms(int64_t timestamp, AVRational time_base)
+{
+    return av_rescale_q(timestamp, time_base, AVRational{1, 1000});
+}
+
+//  adds the time until the end of scope to the stage, nothing if timings is not set
+class stage_timer
+{
+public:
+    using duration = std::chrono::steady_clock::duration;
+
+    stage_timer(transcode_timings* timings, duration transcode_timings::* stage)
+        : target(timings ? &(timings->*stage) : nullptr)
+    {
+        if (target)
+            start = std::chrono::steady_clock::now();
+    }
+    ~stage_timer()
+    {
+        if (target)
+            *target += std::chrono::steady_clock::now() - start;
+    }
+
+    stage_timer(stage_timer const&) = delete;
+    stage_timer& operator = (stage_timer const&) = delete;
+private:
+    duration* target;
+    std::chrono::steady_clock::time_point start;
+};
+
+//  the probe results are cached per input, so that the following opens of the same input
+//  don't need to read far into it. the keyframes are cached too, when known
+using probe_loader = meshpp::file_loader<InternalModel::ProbeResult,
+                                         &InternalModel::ProbeResult::from_string,
+                                         &InternalModel::ProbeResult::to_string>;
+
+bool probe_load(filesystem::path const& probe_file,
+                InternalModel::ProbeResult& probe)
+{
+    boost::system::error_code ec;
+    if (probe_file.empty() ||
+        false == filesystem::exists(probe_file, ec))
+        return false;
+
+    try
+    {
+        probe_loader loader(probe_file);
+        probe = *loader.as_const();
+    }
+    catch (...)
+    {
+        return false;
+    }
+
+    return false == probe.streams.empty();
+}
+
+//  written aside and renamed, so that a reader never sees a partial file
+void probe_save(filesystem::path const& probe_file,
+                InternalModel::ProbeResult const& probe)
+{
+    if (probe_file.empty())
+        return;
+
+    boost::system::error_code ec;
+    filesystem::path temp_file = probe_file.parent_path() /
+                                 filesystem::unique_path(probe_file.filename().string() + ".%%%%%%%%.tmp", ec);
+    if (ec)
+        return;
+
+    {
+        filesystem::ofstream file(temp_file, std::ios_base::binary | std::ios_base::trunc);
+        file << probe.to_string();
+        if (false == bool(file))
+        {
+            file.close();
+            filesystem::remove(temp_file, ec);
+            return;     //  the cache is not essential
+        }
+    }
+
+    filesystem::rename(temp_file, probe_file, ec);
+    if (ec)
+        filesystem::remove(temp_file, ec);
+}
+
+void probe_fill(AVFormatContext const& avformat_context,
+                InternalModel::ProbeResult& probe)
+{
+    probe.duration = 0;
+    if (avformat_context.duration != AV_NOPTS_VALUE &&
+        avformat_context.duration > 0)
+    {
+        probe.duration = uint64_t(timestamp_ms(avformat_context.duration, AV_TIME_BASE_Q));
+        if (avformat_context.start_time != AV_NOPTS_VALUE &&
+            avformat_context.start_time > 0)
+            probe.duration += uint64_t(timestamp_ms(avformat_context.start_time, AV_TIME_BASE_Q));
+    }
+
+    probe.streams.clear();
+    for (int index = 0; index < int(avformat_context.nb_streams); ++index)
+    {
+        AVStream const& avstream = *avformat_context.streams[index];
+        AVCodecParameters const& codecpar = *avstream.codecpar;
+
+        InternalModel::ProbeStream stream;
+        stream.codec_id = uint64_t(codecpar.codec_id);
+
+        char const* format_name = nullptr;
+        if (codecpar.codec_type == AVMEDIA_TYPE_VIDEO)
+            format_name = av_get_pix_fmt_name(AVPixelFormat(codecpar.format));
+        else if (codecpar.codec_type == AVMEDIA_TYPE_AUDIO)
+            format_name = av_get_sample_fmt_name(AVSampleFormat(codecpar.format));
+        if (format_name)
+            stream.format = string(format_name);
+
+        stream.width = uint64_t(std::max(0, codecpar.width));
+        stream.height = uint64_t(std::max(0, codecpar.height));
+        stream.video_delay = uint64_t(std::max(0, codecpar.video_delay));
+        stream.sample_rate = uint64_t(std::max(0, codecpar.sample_rate));
+        stream.channels = uint64_t(std::max(0, codecpar.channels));
+        stream.channel_layout = codecpar.channel_layout;
+        stream.frame_size = uint64_t(std::max(0, codecpar.frame_size));
+        stream.block_align = uint64_t(std::max(0, codecpar.block_align));
+        stream.bit_rate = uint64_t(std::max(int64_t(0), codecpar.bit_rate));
+
+        stream.sample_aspect_ratio_num = uint64_t(std::max(0, avstream.sample_aspect_ratio.num));
+        stream.sample_aspect_ratio_den = uint64_t(std::max(0, avstream.sample_aspect_ratio.den));
+        stream.r_frame_rate_num = uint64_t(std::max(0, avstream.r_frame_rate.num));
+        stream.r_frame_rate_den = uint64_t(std::max(0, avstream.r_frame_rate.den));
+        stream.avg_frame_rate_num = uint64_t(std::max(0, avstream.avg_frame_rate.num));
+        stream.avg_frame_rate_den = uint64_t(std::max(0, avstream.avg_frame_rate.den));
+
+        if (codecpar.extradata && codecpar.extradata_size > 0)
+            stream.extradata = meshpp::to_base64(string(reinterpret_cast<char const*>(codecpar.extradata),
+                                                        size_t(codecpar.extradata_size)),
+                                                 false);
+
+        probe.streams.push_back(std::move(stream));
+    }
+}
+
+//  fills in what the short probing did not find. false if the input does not match the cache
+bool probe_apply(InternalModel::ProbeResult const& probe,
+                 AVFormatContext& avformat_context)
+{
+    if (probe.streams.size() != size_t(avformat_context.nb_streams))
+        return false;
+
+    for (int index = 0; index < int(avformat_context.nb_streams); ++index)
+    {
+        AVStream& avstream = *avformat_context.streams[index];
+        AVCodecParameters& codecpar = *avstream.codecpar;
+        auto const& stream = probe.streams[size_t(index)];
+
+        if (uint64_t(codecpar.codec_id) != stream.codec_id)
+            return false;
+
+        if (stream.format && codecpar.codec_type == AVMEDIA_TYPE_VIDEO)
+            codecpar.format = av_get_pix_fmt(stream.format->c_str());
+        else if (stream.format && codecpar.codec_type == AVMEDIA_TYPE_AUDIO)
+            codecpar.format = av_get_sample_fmt(stream.format->c_str());
+
+        codecpar.width = int(stream.width);
+        codecpar.height = int(stream.height);
+        codecpar.video_delay = int(stream.video_delay);
+        codecpar.sample_rate = int(stream.sample_rate);
+        codecpar.channels = int(stream.channels);
+        codecpar.channel_layout = stream.channel_layout;
+        codecpar.frame_size = int(stream.frame_size);
+        codecpar.block_align = int(stream.block_align);
+        codecpar.bit_rate = int64_t(stream.bit_rate);
+
+        avstream.sample_aspect_ratio = AVRational{int(stream.sample_aspect_ratio_num), int(stream.sample_aspect_ratio_den)};
+        avstream.r_frame_rate = AVRational{int(stream.r_frame_rate_num), int(stream.r_frame_rate_den)};
+        avstream.avg_frame_rate = AVRational{int(stream.avg_frame_rate_num), int(stream.avg_frame_rate_den)};
+
+        if (stream.extradata && 0 == codecpar.extradata_size)
+        {
+            string extradata = meshpp::from_base64(*stream.extradata);
+            codecpar.extradata = static_cast<uint8_t*>(av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+            if (nullptr == codecpar.extradata)
+                return false;
+            std::copy(extradata.begin(), extradata.end(), codecpar.extradata);
+            codecpar.extradata_size = int(extradata.size());
+        }
+    }
+
+    return true;
+}
+
+format_context_ptr format_context_alloc_input(string const& filepath,
+                                              InternalModel::ProbeResult const* probe = nullptr)
 {
     auto res = format_context_ptr(nullptr, [](AVFormatContext* p)
     {
@@ -162,10 +369,62 @@ format_context_ptr format_context_alloc_input(string const& filepath)
 
     AVFormatContext* p = avformat_alloc_context();
 
+    if (nullptr != p && probe)
+    {
+        //  only to find the streams, the rest comes from the cache
+        p->probesize = 32 * 1024;
+        p->max_analyze_duration = AV_TIME_BASE / 10;
+    }
+
     if (nullptr != p &&
         0 == avformat_open_input(&p, filepath.c_str(), nullptr, nullptr) &&
-        0 <= avformat_find_stream_info(p, nullptr))
+        0 <= avformat_find_stream_info(p, nullptr) &&
+        (nullptr == probe || probe_apply(*probe, *p)))
         res.reset(p);
+    else if (nullptr != p)
+        avformat_close_input(&p);
+
+    return res;
+}
+
+//  uses the cached probe results if there are any, and caches them otherwise.
+//  the parallel parts of a transcode only read the cache, the steps before them write it
+format_context_ptr format_context_alloc_input(string const& filepath,
+                                              filesystem::path const& probe_file,
+                                              InternalModel::ProbeResult& probe,
+                                              bool cache_write = true)
+{
+    bool cached = probe_load(probe_file, probe);
+    bool short_probe = cached &&
+                       false == (probe.short_probe_mismatch && *probe.short_probe_mismatch);
+
+    if (short_probe)
+    {
+        auto res = format_context_alloc_input(filepath, &probe);
+        if (res)
+            return res;
+    }
+
+    auto res = format_context_alloc_input(filepath);
+    if (nullptr == res ||
+        (cached && false == short_probe))
+        return res;
+
+    //  the keyframes come from reading through the whole input, and are kept
+    auto keyframes = probe.keyframes;
+
+    probe = InternalModel::ProbeResult();
+    probe_fill(*res, probe);
+
+    if (cached)
+    {
+        probe.keyframes = std::move(keyframes);
+        //  the short probe does not find the same streams in this input, it is not tried again
+        probe.short_probe_mismatch = true;
+    }
+
+    if (cache_write)
+        probe_save(probe_file, probe);
 
     return res;
 }
@@ -326,12 +585,27 @@ public:
     }
 };
 
+//  the audio is always encoded at this bit rate
+int64_t const audio_output_bit_rate = 196000;
+
+class EncoderContext;
+class EncoderCodecContextDefinition;
+//  writes the packet to the output of the context, in segment mode it may go to the next segment
+bool write_packet(EncoderContext& context,
+                  EncoderCodecContextDefinition& encoder,
+                  AVPacket* packet);
+
 class EncoderCodecContextDefinition : public CodecContextDefinition
 {
 public:
     AdminModel::MediaTypeDescriptionAVStream* options = nullptr;
+    //  the packets are copied as is, either no transcode is requested,
+    //  or auto_copy found the source already matching the transcode options
+    bool copy = false;
 
     size_t duration = 0;
+    //  the video packets written, encoded or copied
+    uint64_t frames = 0;
     frame_ptr frame = frame_alloc();
     packet_ptr packet = packet_alloc();
 
@@ -339,6 +613,21 @@ public:
     AVFilterContext* filter_context_sink = nullptr;
     filter_graph_ptr filter_graph = filter_graph_null();
 
+    //  the profiles with identical audio options get the packets encoded here,
+    //  and don't encode on their own
+    vector<EncoderCodecContextDefinition*> followers;
+    bool follower = false;
+    //  the context that writes the packets
+    EncoderContext* owner = nullptr;
+
+    //  in milliseconds, the video gets an idr frame on every multiple of it, see EncoderContext
+    int64_t segment_duration = 0;
+    int64_t next_keyframe = 0;
+    //  the stream got to the next segment, its packets wait for the other streams
+    bool passed = false;
+    std::chrono::steady_clock::duration encode_time = std::chrono::steady_clock::duration::zero();
+    transcode_timings* timings = nullptr;
+
     //vector<AVRational> frame_rates;
     //vector<int> formats;
     //vector<int> sample_rates;
@@ -357,6 +646,145 @@ public:
         return true;
     }
 
+    //  parses bitrate values like "2500000", "2500k" or "2.5M"
+    static int64_t parse_bit_rate(string const& value)
+    {
+        char* end = nullptr;
+        double result = std::strtod(value.c_str(), &end);
+        if (end == value.c_str() || result < 0)
+            return 0;
+
+        if (*end == 'k' || *end == 'K')
+            result *= 1000;
+        else if (*end == 'm' || *end == 'M')
+            result *= 1000 * 1000;
+        else if (*end == 'g' || *end == 'G')
+            result *= 1000 * 1000 * 1000;
+
+        return int64_t(result);
+    }
+
+    //  checks whether the decoded source stream already satisfies the transcode options,
+    //  so that encoding it again would only cost time and quality
+    bool source_complies(AdminModel::MediaTypeDescriptionAVStreamTranscode const& options,
+                         DecoderCodecContextDefinition const& decoder,
+                         AVRational input_framerate) const
+    {
+        AVCodec const* encoder = avcodec_find_encoder_by_name(options.codec.c_str());
+        AVCodecParameters const* source = decoder.avstream->codecpar;
+
+        if (nullptr == encoder ||
+            encoder->id != source->codec_id)
+            return false;
+
+        if (options.parameters)
+        {
+            for (auto const& name : {"b", "maxrate"})
+            {
+                auto it = options.parameters->find(name);
+                if (it == options.parameters->end())
+                    continue;
+
+                int64_t bit_rate = parse_bit_rate(it->second);
+                if (0 == source->bit_rate ||
+                    0 == bit_rate ||
+                    source->bit_rate > bit_rate)
+                    return false;
+            }
+        }
+
+        if (decoder.avmedia_type == AVMEDIA_TYPE_AUDIO)
+        {
+            if (options.filter &&
+                (*options.filter)->type() == AdminModel::MediaTypeDescriptionAudioFilter::rtt)
+            {
+                AdminModel::MediaTypeDescriptionAudioFilter const* filter = nullptr;
+                (*options.filter)->get(filter);
+
+                if (filter->volume != 1)
+                    return false;
+            }
+
+            if (source->bit_rate > audio_output_bit_rate)
+                return false;
+
+            //  avcodec_context_init keeps the rate and the channels of the source,
+            //  and takes the first sample format of the encoder
+            if (0 >= source->sample_rate ||
+                0 >= source->channels ||
+                (encoder->sample_fmts && encoder->sample_fmts[0] != source->format))
+                return false;
+
+            if (source->channel_layout &&
+                av_get_channel_layout_nb_channels(source->channel_layout) != source->channels)
+                return false;
+
+            if (encoder->supported_samplerates)
+            {
+                int const* sample_rate = encoder->supported_samplerates;
+                while (*sample_rate && *sample_rate != source->sample_rate)
+                    ++sample_rate;
+                if (0 == *sample_rate)
+                    return false;
+            }
+
+            if (encoder->channel_layouts)
+            {
+                uint64_t channel_layout = source->channel_layout ?
+                                              source->channel_layout :
+                                              uint64_t(av_get_default_channel_layout(source->channels));
+                uint64_t const* supported = encoder->channel_layouts;
+                while (*supported && *supported != channel_layout)
+                    ++supported;
+                if (0 == *supported)
+                    return false;
+            }
+        }
+        else if (decoder.avmedia_type == AVMEDIA_TYPE_VIDEO)
+        {
+            if (encoder->pix_fmts &&
+                encoder->pix_fmts[0] != source->format)
+                return false;
+
+            if (options.filter &&
+                (*options.filter)->type() == AdminModel::MediaTypeDescriptionVideoFilter::rtt)
+            {
+                AdminModel::MediaTypeDescriptionVideoFilter const* filter = nullptr;
+                (*options.filter)->get(filter);
+
+                if (get_rotation(decoder.avstream.get(), filter->rotate) != 0 ||
+                    (filter->stabilize && *filter->stabilize))
+                    return false;
+
+                if (0 == input_framerate.num ||
+                    0 == input_framerate.den)
+                    return false;
+
+                if (filter->adjust)
+                {
+                    //  avcodec_context_init would keep the size as is only in this case
+                    if (0 != source->width % 2 ||
+                        0 != source->height % 2 ||
+                        uint64_t(source->width) > filter->width ||
+                        uint64_t(source->height) > filter->height)
+                        return false;
+
+                    if (av_cmp_q(input_framerate, AVRational{int(filter->fps), 1}) > 0)
+                        return false;
+                }
+                //  otherwise the output is exactly as in the filter, or nothing
+                else if (uint64_t(source->width) != filter->width ||
+                         uint64_t(source->height) != filter->height ||
+                         av_cmp_q(input_framerate, AVRational{int(filter->fps), 1}) != 0)
+                    return false;
+            }
+        }
+        else
+            return false;
+
+        return true;
+    }
+
     void avcodec_context_init(AdminModel::MediaTypeDescriptionAVStreamTranscode& options,
                               DecoderCodecContextDefinition const& decoder,
                               AVRational input_framerate,
@@ -405,12 +833,11 @@ public:
             */
             //
             //int OUTPUT_CHANNELS = 2;
-            int OUTPUT_BIT_RATE = 196000;
             avcodec_context->channels       = decoder.avcodec_context->channels;
             avcodec_context->channel_layout = decoder.avcodec_context->channel_layout;//av_get_default_channel_layout(avcodec_context->channels);
             avcodec_context->sample_rate    = decoder.avcodec_context->sample_rate;
             avcodec_context->sample_fmt     = avcodec->sample_fmts[0];
-            avcodec_context->bit_rate       = OUTPUT_BIT_RATE;
+            avcodec_context->bit_rate       = audio_output_bit_rate;
             avcodec_context->time_base      = (AVRational){1, decoder.avcodec_context->sample_rate};
 
             avcodec_context->strict_std_compliance = FF_COMPLIANCE_NORMAL;
@@ -997,6 +1424,7 @@ public:
     bool prepare(format_context_ptr& avformat_context,
                  AVRational input_framerate,
                  DecoderCodecContextDefinition const& decoder,
+                 bool allow_auto_copy,
                  bool& skip)
     {
         skip = false;
@@ -1006,7 +1434,31 @@ public:
         index = decoder.index;
         avmedia_type = decoder.avmedia_type;
 
-        if (!options->transcode)
+        copy = !options->transcode;
+
+        if (allow_auto_copy &&
+            options->transcode &&
+            options->transcode->auto_copy &&
+            *options->transcode->auto_copy &&
+            source_complies(*options->transcode, decoder, input_framerate))
+        {
+            copy = true;
+
+            //  the refined description has to tell what is actually stored
+            if (options->transcode->filter &&
+                (*options->transcode->filter)->type() == AdminModel::MediaTypeDescriptionVideoFilter::rtt)
+            {
+                AdminModel::MediaTypeDescriptionVideoFilter* filter = nullptr;
+                (*options->transcode->filter)->get(filter);
+
+                filter->height = decoder.avstream->codecpar->height;
+                filter->width = decoder.avstream->codecpar->width;
+                filter->fps = input_framerate.num / input_framerate.den +
+                              (0 == input_framerate.num % input_framerate.den ? 0 : 1);
+            }
+        }
+
+        if (copy)
         {
             if (0 > avcodec_parameters_copy(avstream->codecpar, decoder.avstream->codecpar))
             {
@@ -1044,6 +1496,15 @@ public:
         if (avformat_context->oformat->flags & AVFMT_GLOBALHEADER)
             avcodec_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
+        //  the keyframes at the segment bounds are idr, and no scene cut puts one elsewhere,
+        //  so every profile has the same gops. the encoders without these options ignore them
+        if (segment_duration &&
+            avmedia_type == AVMEDIA_TYPE_VIDEO)
+        {
+            av_opt_set(avcodec_context.get(), "forced-idr", "1", AV_OPT_SEARCH_CHILDREN);
+            av_opt_set(avcodec_context.get(), "sc_threshold", "0", AV_OPT_SEARCH_CHILDREN);
+        }
+
         if (0 > avcodec_open2(avcodec_context.get(), avcodec.get(), nullptr/*&ret*/))
         {
             //logging("could not open the codec");
@@ -1062,21 +1523,48 @@ public:
         return true;
     }
 
-    bool process_encode_frame(format_context_ptr& avformat_context,
-                              DecoderCodecContextDefinition const& decoder)
+    bool process_encode_frame(DecoderCodecContextDefinition const& decoder)
     {
         packet_unref(packet);
 
         //  encode the frame
         if (frame && avmedia_type == AVMEDIA_TYPE_VIDEO)
+        {
             frame->pict_type = AV_PICTURE_TYPE_NONE;
-        int response = avcodec_send_frame(avcodec_context.get(),
+
+            //  the first frame at or after the segment bound is the keyframe, in every profile.
+            //  the time is taken the way the packet gets it, so write_packet cuts right there
+            if (segment_duration &&
+                frame->pts != AV_NOPTS_VALUE)
+            {
+                AVRational frame_tb = decoder.avstream->time_base;
+                if (filter_context_sink)
+                    frame_tb = av_buffersink_get_time_base(filter_context_sink);
+
+                int64_t timestamp = timestamp_ms(av_rescale_q(frame->pts, frame_tb, avstream->time_base),
+                                                 avstream->time_base);
+                if (timestamp >= next_keyframe)
+                {
+                    frame->pict_type = AV_PICTURE_TYPE_I;
+                    while (next_keyframe <= timestamp)
+                        next_keyframe += segment_duration;
+                }
+            }
+        }
+        int response;
+        {
+            stage_timer timer(timings, &transcode_timings::encode);
+            response = avcodec_send_frame(avcodec_context.get(),
                                           frame.get());
+        }
 
         while (response >= 0)
         {
-            response = avcodec_receive_packet(avcodec_context.get(),
-                                              packet.get());
+            {
+                stage_timer timer(timings, &transcode_timings::encode);
+                response = avcodec_receive_packet(avcodec_context.get(),
+                                                  packet.get());
+            }
             if (response == AVERROR(EAGAIN) ||
                 response == AVERROR_EOF)
                 break;
@@ -1115,12 +1603,36 @@ public:
             
             //std::cout << duration << ((avmedia_type == AVMEDIA_TYPE_VIDEO) ? "\tvideo\n" : "\taudio\n");
 
-            if (0 != av_interleaved_write_frame(avformat_context.get(),
-                                                packet.get()))
+            for (auto& item : followers)
+            {
+                EncoderCodecContextDefinition& follower_encoder = *item;
+
+                packet_unref(follower_encoder.packet);
+                if (0 > av_packet_ref(follower_encoder.packet.get(), packet.get()))
+                    return false;
+
+                follower_encoder.packet->stream_index = follower_encoder.avstream->index;
+                av_packet_rescale_ts(follower_encoder.packet.get(),
+                                     avstream->time_base,
+                                     follower_encoder.avstream->time_base);
+                follower_encoder.duration = duration;
+
+                if (false == write_packet(*follower_encoder.owner,
+                                          follower_encoder,
+                                          follower_encoder.packet.get()))
+                    return false;
+            }
+
+            if (false == write_packet(*owner,
+                                      *this,
+                                      packet.get()))
             {
                 //logging("Error %d while receiving packet from decoder: %s", response, av_err2str(response));
                 return false;
             }
+
+            if (avmedia_type == AVMEDIA_TYPE_VIDEO)
+                ++frames;
         }
 
         return true;
@@ -1154,6 +1666,130 @@ public:
     }
 };
 
+//  the muxer writes the file through this, and the data is hashed on the way
+//  so the output does not need to be read back. if the muxer goes back to rewrite
+//  the bytes already hashed, as progressive mp4 does for the mdat size, the hash
+//  is dropped and not computed further, sha256 cannot redo a range in the middle.
+//  mp4 and mov are fragmented by default for this, see EncoderContext::load,
+//  webm and mpegts are written front to back anyway. storage reads the rest back
+class OutputFile
+{
+public:
+    AVIOContext* avio_context = nullptr;
+    uint64_t size = 0;
+
+    OutputFile() = default;
+    OutputFile(OutputFile const&) = delete;
+    ~OutputFile()
+    {
+        close();
+    }
+
+    bool open(string const& path)
+    {
+        file.rdbuf()->pubsetbuf(nullptr, 0);
+        file.open(path, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        if (!file)
+            return false;
+
+        size_t const buffer_size = 64 * 1024;
+        unsigned char* buffer = static_cast<unsigned char*>(av_malloc(buffer_size));
+        if (nullptr == buffer)
+            return false;
+
+        avio_context = avio_alloc_context(buffer, int(buffer_size), 1, this, nullptr, &OutputFile::write, &OutputFile::seek);
+        if (nullptr == avio_context)
+        {
+            av_free(buffer);
+            return false;
+        }
+
+        return true;
+    }
+
+    void close()
+    {
+        if (avio_context)
+        {
+            avio_flush(avio_context);
+            av_freep(&avio_context->buffer);
+            avio_context_free(&avio_context);
+        }
+        if (file.is_open())
+            file.close();
+    }
+
+    //  empty if the output was rewritten
+    string hash_result()
+    {
+        if (hash_valid && hash.size() == size)
+        {
+            hash_valid = false;
+            return hash.result();
+        }
+        return string();
+    }
+
+private:
+    static int write(void* opaque, uint8_t* data, int data_size)
+    {
+        OutputFile& self = *static_cast<OutputFile*>(opaque);
+
+        if (data_size <= 0)
+            return 0;
+
+        if (false == bool(self.file.write(reinterpret_cast<char const*>(data), data_size)))
+            return AVERROR(EIO);
+
+        //  once rewritten, the rest is not hashed for nothing
+        if (self.hash_valid && self.position == self.hash.size())
+            self.hash.update(reinterpret_cast<char const*>(data), size_t(data_size));
+        else
+            self.hash_valid = false;
+
+        self.position += uint64_t(data_size);
+        self.size = std::max(self.size, self.position);
+
+        return data_size;
+    }
+
+    static int64_t seek(void* opaque, int64_t offset, int whence)
+    {
+        OutputFile& self = *static_cast<OutputFile*>(opaque);
+
+        if (whence & AVSEEK_SIZE)
+            return int64_t(self.size);
+
+        int64_t target;
+        switch (whence & ~AVSEEK_FORCE)
+        {
+        case SEEK_SET:
+            target = offset;
+            break;
+        case SEEK_CUR:
+            target = int64_t(self.position) + offset;
+            break;
+        case SEEK_END:
+            target = int64_t(self.size) + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+        }
+
+        if (target < 0 ||
+            false == bool(self.file.seekp(target)))
+            return AVERROR(EIO);
+
+        self.position = uint64_t(target);
+        return target;
+    }
+
+    filesystem::ofstream file;
+    cloudy::stream_hash hash;
+    uint64_t position = 0;
+    bool hash_valid = true;
+};
+
 class DecoderContext;
 class EncoderContext : public Context<EncoderCodecContextDefinition>
 {
@@ -1161,33 +1797,209 @@ public:
     size_t option_index = 0;
     string filepath;
     AVDictionary* muxer_opts = nullptr;
+    std::unique_ptr<OutputFile> output;
+    string output_hash;
+    uint64_t output_size = 0;
+    transcode_timings* timings = nullptr;
+
+    //  in segment mode the output is cut on every multiple of segment_duration from the
+    //  start of the input, and the next file is opened for the same encoders. the segment
+    //  bounds are in milliseconds from the start of the part, same as the packets
+    int64_t segment_duration = 0;
+    int64_t segment_start = 0;
+    int64_t segment_end = 0;
+    //  counts from the start of the input, names the files
+    uint64_t segment_number = 0;
+    //  what the input has left after the part start, zero if not known
+    int64_t end_of_input = 0;
+    //  the packets of the streams already in the next segment
+    vector<packet_ptr> held;
+    //  the segments written and not taken by the transcoder yet
+    std::deque<cloudy::work_unit> segments;
 
     AVFilterGraph *graph;
 
     bool load(size_t option_index,
               AdminModel::MediaTypeDescriptionVariant& options,
               DecoderContext& decoder,
-              filesystem::path const& output_dir);
+              filesystem::path const& output_dir,
+              string const& output_suffix);
     bool process(DecoderContext& decoder_context,
                  DataUnit& data_unit);
     bool final(DecoderContext& decoder_context);
+    //  closes the segment and opens the next one, the held packets go there
+    bool cut();
+protected:
+    bool open_output();
+    void close_output();
+    void segment_done(int64_t duration);
+
+    filesystem::path output_dir;
+    string extension;
 };
 
+//  how far apart the streams of one output may get, in milliseconds
+int64_t const segment_interleave_margin = 10000;
+
+bool write_packet(EncoderContext& context,
+                  EncoderCodecContextDefinition& encoder,
+                  AVPacket* packet)
+{
+    if (context.segment_duration &&
+        packet->pts != AV_NOPTS_VALUE)
+    {
+        int64_t timestamp = timestamp_ms(packet->pts, encoder.avstream->time_base);
+
+        //  the video moves on with the keyframe forced at the bound
+        if (false == encoder.passed &&
+            timestamp >= context.segment_end &&
+            (encoder.avmedia_type != AVMEDIA_TYPE_VIDEO ||
+             (packet->flags & AV_PKT_FLAG_KEY)))
+            encoder.passed = true;
+
+        if (encoder.passed)
+        {
+            packet_ptr held_packet = packet_alloc();
+            if (0 > av_packet_ref(held_packet.get(), packet))
+                return false;
+            context.held.push_back(std::move(held_packet));
+
+            //  a stream that never gets to the bound does not keep the others waiting
+            bool all_passed = true;
+            for (auto const& item : context.definitions)
+                all_passed = all_passed && item.passed;
+
+            if (all_passed ||
+                timestamp >= context.segment_end + segment_interleave_margin)
+                return context.cut();
+
+            return true;
+        }
+
+        //  every segment starts from zero
+        int64_t shift = av_rescale_q(context.segment_start, AVRational{1, 1000}, encoder.avstream->time_base);
+        packet->pts -= shift;
+        if (packet->dts != AV_NOPTS_VALUE)
+            packet->dts -= shift;
+    }
+
+    stage_timer timer(context.timings, &transcode_timings::mux);
+    return 0 == av_interleaved_write_frame(context.avformat_context.get(),
+                                           packet);
+}
+
 class DecoderContext : public Context<DecoderCodecContextDefinition>
 {
 public:
+    //  the part of the input to decode, in milliseconds. the timestamps are shifted
+    //  so that the part starts from zero. zero end means the end of input
+    int64_t start = 0;
+    int64_t end = 0;
+    filesystem::path probe_file;
+    //  the part bounds don't fall on keyframes. the decoding starts from the keyframe before,
+    //  and the frames outside the part are dropped after decoding
+    bool accurate = false;
+    //  the video frames decoded within the part
+    uint64_t video_frames = 0;
+    //  of the whole input, in milliseconds, as probed
+    uint64_t input_duration = 0;
+    transcode_timings* timings = nullptr;
+
     bool load(string const& path);
     bool next(vector<EncoderContext>& encoder_contexts,
               DataUnit& data_unit);
 protected:
-    bool scan_avformat_context()
+    //  the streams that reached the end of the part
+    unordered_set<int> ended;
+
+    //  reads the next packet within the part, false on the end of the part
+    bool read_packet(packet_ptr& packet)
     {
-        for (int index = 0; index < int(avformat_context->nb_streams); ++index)
+        while (read_frame(packet))
         {
-            AVStream& avstream = *avformat_context->streams[index];
-            if (false == add_definition(avstream, index))
-                return false;
-        }
+            DecoderCodecContextDefinition* pdecoder = nullptr;
+            if (false == codec_context_definition_by_stream(packet->stream_index, pdecoder) ||
+                nullptr == pdecoder ||
+                (0 == start && 0 == end) ||
+                packet->pts == AV_NOPTS_VALUE)
+                return true;
+
+            AVRational time_base = pdecoder->avstream->time_base;
+            int64_t timestamp = timestamp_ms(packet->pts, time_base);
+            //  the frames within the part need only the packets before the end in decoding order.
+            //  with open gop the keyframe at the end is a reference of the frames before it,
+            //  so it is decoded too, and the frames at and after the end are dropped
+            int64_t end_timestamp = timestamp;
+            if (packet->dts != AV_NOPTS_VALUE)
+                end_timestamp = timestamp_ms(packet->dts, time_base);
+
+            if (end && end_timestamp >= end)
+            {
+                ended.insert(packet->stream_index);
+                //  the interleaving in the input does not go this far
+                if (ended.size() == definitions.size() ||
+                    timestamp >= end + part_interleave_margin)
+                    return false;
+            }
+            else if (0 == ended.count(packet->stream_index) &&
+                     (0 == start || accurate || timestamp >= start))
+            {
+                int64_t shift = av_rescale_q(start, AVRational{1, 1000}, time_base);
+                packet->pts -= shift;
+                if (packet->dts != AV_NOPTS_VALUE)
+                    packet->dts -= shift;
+
+                return true;
+            }
+
+            packet_unref(packet);
+        }
+
+        return false;
+    }
+
+    bool read_frame(packet_ptr& packet)
+    {
+        stage_timer timer(timings, &transcode_timings::demux);
+        return 0 <= av_read_frame(avformat_context.get(), packet.get());
+    }
+
+    bool frame_within_part(DecoderCodecContextDefinition const& decoder,
+                           frame_ptr const& frame) const
+    {
+        if (frame->pts == AV_NOPTS_VALUE)
+            return true;
+
+        //  the timestamps are already shifted by start
+        int64_t timestamp = timestamp_ms(frame->pts, decoder.avstream->time_base);
+        if (accurate && timestamp < 0)
+            return false;
+
+        return 0 == end || timestamp < end - start;
+    }
+
+    //  the copied packets are cut on the presentation time, same as the decoded frames
+    bool packet_within_part(DecoderCodecContextDefinition const& decoder,
+                            packet_ptr const& packet) const
+    {
+        if (0 == end ||
+            packet->pts == AV_NOPTS_VALUE)
+            return true;
+
+        int64_t timestamp = timestamp_ms(packet->pts, decoder.avstream->time_base);
+        return timestamp < end - start;
+    }
+
+    static int64_t const part_interleave_margin = 10000;
+
+    bool scan_avformat_context()
+    {
+        for (int index = 0; index < int(avformat_context->nb_streams); ++index)
+        {
+            AVStream& avstream = *avformat_context->streams[index];
+            if (false == add_definition(avstream, index))
+                return false;
+        }
 
         return true;
     }
@@ -1209,16 +2021,26 @@ protected:
 
 bool DecoderContext::load(string const& path)
 {
-    avformat_context = format_context_alloc_input(path);
+    InternalModel::ProbeResult probe;
+    avformat_context = format_context_alloc_input(path, probe_file, probe, false);
     if (nullptr == avformat_context)
     {
         //logging("failed to init format context");
         return false;
     }
+    input_duration = probe.duration;
 
     if (false == scan_avformat_context())
         return false;
 
+    if (start)
+    {
+        //  the keyframe part starts exactly here, the accurate one at the keyframe before
+        int64_t timestamp = av_rescale_q(start, AVRational{1, 1000}, AV_TIME_BASE_Q);
+        if (0 > avformat_seek_file(avformat_context.get(), -1, INT64_MIN, timestamp, timestamp, 0))
+            return false;
+    }
+
     //filepath = path;
 
     return true;
@@ -1234,7 +2056,7 @@ bool DecoderContext::next(vector<EncoderContext>& encoder_contexts,
     {
         packet_unref(data_unit.packet);
 
-        if (0 > av_read_frame(avformat_context.get(), data_unit.packet.get()))
+        if (false == read_packet(data_unit.packet))
             data_unit.more_read_packet = false;
         else
         {
@@ -1255,16 +2077,18 @@ bool DecoderContext::next(vector<EncoderContext>& encoder_contexts,
                     EncoderCodecContextDefinition& encoder = *pencoder;
                     DecoderCodecContextDefinition& decoder = *pdecoder;
 
-                    if (!encoder.options->transcode &&
-                        false == input_packet_done)
+                    if (encoder.copy)
                     {
-                        input_packet_done = true;
+                        if (false == input_packet_done &&
+                            packet_within_part(decoder, data_unit.packet))
+                            input_packet_done = true;
                     }
-                    else if (encoder.options->transcode &&
+                    else if (false == encoder.copy &&
                              false == input_frames_done)
                     {
                         input_frames_done = true;
 
+                        stage_timer timer(timings, &transcode_timings::decode);
                         int response = avcodec_send_packet(decoder.avcodec_context.get(),
                                                            data_unit.packet.get());
                         if (response < 0)
@@ -1298,14 +2122,17 @@ bool DecoderContext::next(vector<EncoderContext>& encoder_contexts,
                 EncoderCodecContextDefinition& encoder = *pencoder;
                 DecoderCodecContextDefinition& decoder = *pdecoder;
 
-                if (encoder.options->transcode)
+                if (false == encoder.copy)
                 {
                     int response;
 
                     frame_unref(data_unit.frame);
 
-                    response = avcodec_receive_frame(decoder.avcodec_context.get(),
-                                                     data_unit.frame.get());
+                    {
+                        stage_timer timer(timings, &transcode_timings::decode);
+                        response = avcodec_receive_frame(decoder.avcodec_context.get(),
+                                                         data_unit.frame.get());
+                    }
                     if (response == AVERROR(EAGAIN) ||
                         response == AVERROR_EOF)
                         data_unit.more_read_frame = false;
@@ -1314,12 +2141,20 @@ bool DecoderContext::next(vector<EncoderContext>& encoder_contexts,
                         //logging("Error while receiving frame from decoder: %s", av_err2str(response));
                         return false;
                     }
+                    else if (false == frame_within_part(decoder, data_unit.frame))
+                    {
+                        //  more_read_frame stays, the next frame is received on the next call
+                        frame_unref(data_unit.frame);
+                    }
                     else
                     {
                         data_unit.more_write_frame = true;
+                        if (decoder.avmedia_type == AVMEDIA_TYPE_VIDEO)
+                            ++video_frames;
                     }
+                    //  the stream is decoded once for all the profiles
+                    break;
                 }
-                break;
             }
         }
     }
@@ -1330,7 +2165,8 @@ bool DecoderContext::next(vector<EncoderContext>& encoder_contexts,
 bool EncoderContext::load(size_t option_index_,
                           AdminModel::MediaTypeDescriptionVariant& options,
                           DecoderContext& decoder_context,
-                          filesystem::path const& output_dir)
+                          filesystem::path const& output_dir_,
+                          string const& output_suffix)
 {
     if (options->type() != AdminModel::MediaTypeDescriptionAVContainer::rtt)
         return true;
@@ -1340,7 +2176,22 @@ bool EncoderContext::load(size_t option_index_,
     AdminModel::MediaTypeDescriptionAVContainer* container_options;
     options->get(container_options);
 
-    filepath = (output_dir / (std::to_string(option_index_) + "." + container_options->container_extension)).string();
+    output_dir = output_dir_;
+    extension = container_options->container_extension;
+
+    string suffix = output_suffix;
+    if (segment_duration)
+    {
+        //  the part may start off the bounds when resumed, then the first segment is shorter
+        segment_number = uint64_t(decoder_context.start / segment_duration);
+        segment_end = int64_t(segment_number + 1) * segment_duration - decoder_context.start;
+        if (decoder_context.input_duration > uint64_t(decoder_context.start))
+            end_of_input = int64_t(decoder_context.input_duration) - decoder_context.start;
+
+        suffix = "_" + std::to_string(segment_number);
+    }
+
+    filepath = (output_dir / (std::to_string(option_index_) + suffix + "." + extension)).string();
 
     avformat_context = format_context_alloc_output(filepath);
     if (nullptr == avformat_context)
@@ -1376,10 +2227,15 @@ bool EncoderContext::load(size_t option_index_,
         
         if (is_set)
         {
+            encoder.segment_duration = segment_duration;
+            encoder.next_keyframe = segment_end;
+
             bool skip = false;
+            //  the copied packets can't be cut exactly on the part start or the segment bounds
             if (false == encoder.prepare(avformat_context,
                                          input_framerate,
                                          decoder,
+                                         false == decoder_context.accurate && 0 == segment_duration,
                                          skip))
                 return false;
 
@@ -1399,15 +2255,6 @@ bool EncoderContext::load(size_t option_index_,
     if (avformat_context->oformat->flags & AVFMT_GLOBALHEADER)
         avformat_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
-    if (!(avformat_context->oformat->flags & AVFMT_NOFILE))
-    {
-        if (avio_open(&avformat_context->pb, filepath.c_str(), AVIO_FLAG_WRITE) < 0)
-        {
-            //logging("could not open the output file");
-            return false;
-        }
-    }
-
     if (container_options->muxer_parameters)
     for (auto const& item : *container_options->muxer_parameters)
     {
@@ -1420,8 +2267,36 @@ bool EncoderContext::load(size_t option_index_,
                     0);
     }
 
-    if (0 > avformat_write_header(avformat_context.get(),
-                                  &muxer_opts))
+    //  written front to back, so that the output is hashed on the way, see OutputFile.
+    //  muxer_parameters can still ask for the progressive layout
+    string muxer_name = avformat_context->oformat->name;
+    if ((muxer_name == "mp4" || muxer_name == "mov") &&
+        nullptr == av_dict_get(muxer_opts, "movflags", nullptr, 0))
+        av_dict_set(&muxer_opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+
+    return open_output();
+}
+
+bool EncoderContext::open_output()
+{
+    if (!(avformat_context->oformat->flags & AVFMT_NOFILE))
+    {
+        output.reset(new OutputFile());
+        if (false == output->open(filepath))
+        {
+            //logging("could not open the output file");
+            return false;
+        }
+        avformat_context->pb = output->avio_context;
+    }
+
+    //  every segment is opened with the same options, the muxer takes out the ones it uses
+    AVDictionary* opts = nullptr;
+    av_dict_copy(&opts, muxer_opts, 0);
+    int response = avformat_write_header(avformat_context.get(),
+                                         &opts);
+    av_dict_free(&opts);
+    if (0 > response)
     {
         //logging("an error occurred when opening output file");
         return false;
@@ -1431,6 +2306,95 @@ bool EncoderContext::load(size_t option_index_,
 
     return true;
 }
+
+void EncoderContext::close_output()
+{
+    {
+        stage_timer timer(timings, &transcode_timings::mux);
+        av_write_trailer(avformat_context.get());
+    }
+
+    if (output)
+    {
+        output->close();
+        output_size = output->size;
+        output_hash = output->hash_result();
+        output.reset();
+    }
+}
+
+void EncoderContext::segment_done(int64_t duration)
+{
+    cloudy::work_unit segment;
+    segment.duration = duration > 0 ? uint64_t(duration) : 0;
+    segment.result_type = InternalModel::ResultType::file;
+    segment.data_or_file = filepath;
+    segment.data_hash = output_hash;
+    segment.data_size = output_size;
+
+    segments.push_back(std::move(segment));
+}
+
+bool EncoderContext::cut()
+{
+    close_output();
+    segment_done(segment_end - segment_start);
+
+    ++segment_number;
+    segment_start = segment_end;
+    segment_end += segment_duration;
+    filepath = (output_dir / (std::to_string(option_index) + "_" + std::to_string(segment_number) + "." + extension)).string();
+
+    //  the same encoders go on into the new file, its streams take their parameters
+    auto previous = std::move(avformat_context);
+    avformat_context = format_context_alloc_output(filepath);
+    if (nullptr == avformat_context)
+        return false;
+
+    avformat_context->flags = previous->flags;
+
+    vector<AVRational> previous_time_bases;
+    for (auto& encoder : definitions)
+    {
+        AVStream* previous_stream = encoder.avstream.get();
+        previous_time_bases.push_back(previous_stream->time_base);
+
+        encoder.avstream = format_new_stream(avformat_context);
+        if (nullptr == encoder.avstream ||
+            0 > avcodec_parameters_copy(encoder.avstream->codecpar, previous_stream->codecpar))
+            return false;
+
+        encoder.avstream->time_base = previous_stream->time_base;
+        encoder.passed = false;
+    }
+
+    previous.reset();
+
+    if (false == open_output())
+        return false;
+
+    //  the muxer may have picked another time base
+    auto packets = std::move(held);
+    held.clear();
+    for (auto& item : packets)
+    {
+        for (size_t index = 0; index != definitions.size(); ++index)
+        {
+            auto& encoder = definitions[index];
+            if (encoder.avstream->index != item->stream_index)
+                continue;
+
+            av_packet_rescale_ts(item.get(),
+                                 previous_time_bases[index],
+                                 encoder.avstream->time_base);
+            if (false == write_packet(*this, encoder, item.get()))
+                return false;
+            break;
+        }
+    }
+
+    return true;
+}
 bool EncoderContext::process(DecoderContext& decoder_context,
                              DataUnit& data_unit)
 {
@@ -1452,7 +2416,7 @@ bool EncoderContext::process(DecoderContext& decoder_context,
 
             DecoderCodecContextDefinition& decoder = *pdecoder;
 
-            if (!encoder.options->transcode)
+            if (encoder.copy)
             {
                 packet_ptr& output_packet = encoder.packet;
                 packet_unref(output_packet);
@@ -1469,12 +2433,16 @@ bool EncoderContext::process(DecoderContext& decoder_context,
                 encoder.duration = 1000 * double(output_packet->dts) /
                                     double(encoder.avstream->time_base.den) * double(encoder.avstream->time_base.num);
 
-                if (0 != av_interleaved_write_frame(avformat_context.get(),
-                                                    output_packet.get()))
+                if (false == write_packet(*this,
+                                          encoder,
+                                          output_packet.get()))
                 {
                     //logging("error while copying stream packet");
                     return false;
                 }
+
+                if (encoder.avmedia_type == AVMEDIA_TYPE_VIDEO)
+                    ++encoder.frames;
             }
         }
     }
@@ -1494,7 +2462,13 @@ bool EncoderContext::process(DecoderContext& decoder_context,
 
             DecoderCodecContextDefinition& decoder = *pdecoder;
 
-            if (encoder.options->transcode)
+            //  written along with the profile that encodes the shared audio
+            if (encoder.follower)
+                continue;
+
+            auto encode_start = std::chrono::steady_clock::now();
+
+            if (false == encoder.copy)
             {
                 if (encoder.avmedia_type == AVMEDIA_TYPE_VIDEO)
                     data_unit.frame->pict_type = AV_PICTURE_TYPE_NONE;
@@ -1506,6 +2480,7 @@ bool EncoderContext::process(DecoderContext& decoder_context,
                     encoder.filter_context_source)
                 {
                     //  video example shows AV_BUFFERSRC_FLAG_KEEP_REF instead of 0 below
+                    stage_timer timer(timings, &transcode_timings::filter);
                     if (0 > av_buffersrc_add_frame_flags(encoder.filter_context_source,
                                                          flush ? nullptr : encoder.frame.get(),
                                                          0))//AV_BUFFERSRC_FLAG_PUSH))
@@ -1525,16 +2500,19 @@ bool EncoderContext::process(DecoderContext& decoder_context,
                         //int response = av_buffersink_get_frame_flags(encoder.filter_context_sink,
                         //                                             encoder.frame.get(),
                         //                                             AV_BUFFERSINK_FLAG_NO_REQUEST);
-                        int response = av_buffersink_get_frame(encoder.filter_context_sink,
+                        int response;
+                        {
+                            stage_timer timer(timings, &transcode_timings::filter);
+                            response = av_buffersink_get_frame(encoder.filter_context_sink,
                                                                encoder.frame.get());
+                        }
                         if (response == AVERROR(EAGAIN) ||
                             response == AVERROR_EOF)
                         {
                             if (flush)
                             {
                                 encoder.frame.reset();
-                                encoder.process_encode_frame(avformat_context,
-                                                             decoder);
+                                encoder.process_encode_frame(decoder);
                             }
                             break;
                         }
@@ -1542,8 +2520,7 @@ bool EncoderContext::process(DecoderContext& decoder_context,
                             return false;
                         else
                         {
-                            encoder.process_encode_frame(avformat_context,
-                                                         decoder);
+                            encoder.process_encode_frame(decoder);
                         }
                     }
                 }
@@ -1551,11 +2528,13 @@ bool EncoderContext::process(DecoderContext& decoder_context,
                 {
                     if (flush)
                         encoder.frame.reset();
-                    encoder.process_encode_frame(avformat_context,
-                                                 decoder);
+                    encoder.process_encode_frame(decoder);
                 }
             }
 
+            if (false == encoder.followers.empty())
+                encoder.encode_time += std::chrono::steady_clock::now() - encode_start;
+
             if (flush)
                 encoder.avcodec_context.reset();
         }
@@ -1563,7 +2542,22 @@ bool EncoderContext::process(DecoderContext& decoder_context,
 
     if (flush)
     {
-        av_write_trailer(avformat_context.get());
+        //  the packets past the last bound, that the other streams did not get to
+        while (false == held.empty())
+        {
+            if (false == cut())
+                return false;
+        }
+
+        close_output();
+
+        if (segment_duration)
+        {
+            int64_t last_end = end_of_input;
+            if (0 == last_end)
+                last_end = int64_t(definitions.front().duration);
+            segment_done(last_end - segment_start);
+        }
 
         if (muxer_opts != nullptr)
         {
@@ -1582,15 +2576,521 @@ class transcoder_detail
 public:
     DecoderContext decoder;
     vector<EncoderContext> encoders;
+    transcode_timings timings;
+    //  kept between the runs, in segment mode the loop returns on every segment
+    DataUnit data_unit;
+    std::chrono::steady_clock::time_point progress_reported;
+
+    //  a segment of every option, once all of them have it. after the end of input
+    //  the options with more segments give the rest
+    unordered_map<size_t, cloudy::work_unit> next_segment(bool all)
+    {
+        unordered_map<size_t, cloudy::work_unit> result;
+
+        for (auto const& encoder_context : encoders)
+        {
+            if (all && encoder_context.segments.empty())
+                return result;
+        }
+
+        for (auto& encoder_context : encoders)
+        {
+            if (encoder_context.segments.empty())
+                continue;
+
+            result[encoder_context.option_index] = std::move(encoder_context.segments.front());
+            encoder_context.segments.pop_front();
+        }
+
+        return result;
+    }
+
+    unordered_map<size_t, uint64_t> encoded_frames() const
+    {
+        unordered_map<size_t, uint64_t> result;
+        for (auto const& encoder_context : encoders)
+        {
+            uint64_t& frames = result[encoder_context.option_index];
+            for (auto const& encoder : encoder_context.definitions)
+                frames += encoder.frames;
+        }
+
+        return result;
+    }
+
+    void share_audio_encoders()
+    {
+        for (size_t index = 0; index != encoders.size(); ++index)
+        for (auto& candidate : encoders[index].definitions)
+        {
+            if (candidate.avmedia_type != AVMEDIA_TYPE_AUDIO ||
+                candidate.copy)
+                continue;
+
+            int candidate_global_header = encoders[index].avformat_context->oformat->flags & AVFMT_GLOBALHEADER;
+
+            for (size_t leader_index = 0;
+                 leader_index != index && false == candidate.follower;
+                 ++leader_index)
+            for (auto& leader : encoders[leader_index].definitions)
+            {
+                int leader_global_header = encoders[leader_index].avformat_context->oformat->flags & AVFMT_GLOBALHEADER;
+
+                if (leader.avmedia_type != AVMEDIA_TYPE_AUDIO ||
+                    leader.copy ||
+                    leader.follower ||
+                    leader.index != candidate.index ||
+                    leader_global_header != candidate_global_header ||
+                    false == (*leader.options->transcode == *candidate.options->transcode))
+                    continue;
+
+                leader.followers.push_back(&candidate);
+                candidate.follower = true;
+                candidate.avcodec_context.reset();
+                candidate.filter_context_source = nullptr;
+                candidate.filter_context_sink = nullptr;
+                candidate.filter_graph.reset();
+                break;
+            }
+        }
+    }
+
+    void count_shared_audio()
+    {
+        timings.shared_audio = 0;
+        timings.shared_audio_saved = std::chrono::steady_clock::duration::zero();
+
+        for (auto const& encoder_context : encoders)
+        for (auto const& encoder : encoder_context.definitions)
+        {
+            if (encoder.followers.empty())
+                continue;
+
+            timings.shared_audio_saved += encoder.encode_time * int64_t(encoder.followers.size());
+            timings.shared_audio += encoder.followers.size();
+        }
+    }
 };
 
+vector<pair<uint64_t, uint64_t>> split_parts(filesystem::path const& input_file,
+                                             filesystem::path const& probe_file,
+                                             uint64_t part_duration)
+{
+    vector<pair<uint64_t, uint64_t>> result;
+    result.push_back(std::make_pair(uint64_t(0), uint64_t(0)));
+
+    if (0 == part_duration)
+        return result;
+
+    //  opened even with the keyframes cached, so that the cache is checked
+    //  here and not by every part
+    InternalModel::ProbeResult probe;
+    auto avformat_context = format_context_alloc_input(input_file.string(), probe_file, probe);
+    if (nullptr == avformat_context)
+        return result;
+
+    if (!probe.keyframes)
+    {
+        probe.keyframes = vector<uint64_t>();
+
+        int video_index = av_find_best_stream(avformat_context.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (video_index >= 0)
+        {
+            //  only the packet headers of the video are needed, nothing is decoded
+            for (int index = 0; index < int(avformat_context->nb_streams); ++index)
+            {
+                if (index != video_index)
+                    avformat_context->streams[index]->discard = AVDISCARD_ALL;
+            }
+
+            AVRational time_base = avformat_context->streams[video_index]->time_base;
+            auto packet = packet_alloc();
+
+            while (0 <= av_read_frame(avformat_context.get(), packet.get()))
+            {
+                if (packet->stream_index == video_index &&
+                    (packet->flags & AV_PKT_FLAG_KEY) &&
+                    packet->pts != AV_NOPTS_VALUE)
+                {
+                    int64_t timestamp = timestamp_ms(packet->pts, time_base);
+                    if (timestamp > 0)
+                        probe.keyframes->push_back(uint64_t(timestamp));
+                }
+
+                packet_unref(packet);
+            }
+        }
+
+        probe_save(probe_file, probe);
+    }
+
+    for (uint64_t timestamp : *probe.keyframes)
+    {
+        if (timestamp >= result.back().first + part_duration)
+        {
+            result.back().second = timestamp;
+            result.push_back(std::make_pair(timestamp, uint64_t(0)));
+        }
+    }
+
+    return result;
+}
+
+vector<cloudy::work_unit> thumbnails(filesystem::path const& input_file,
+                                     filesystem::path const& probe_file,
+                                     filesystem::path const& output_dir,
+                                     size_t option_index,
+                                     AdminModel::MediaTypeDescriptionThumbnails const& options,
+                                     uint64_t start)
+{
+    vector<cloudy::work_unit> result;
+
+    if (0 == options.interval ||
+        0 == options.width ||
+        0 == options.height ||
+        0 == options.columns ||
+        0 == options.rows)
+        throw std::runtime_error("thumbnails: zero interval, size or tiles");
+
+    InternalModel::ProbeResult probe;
+    auto avformat_context = format_context_alloc_input(input_file.string(), probe_file, probe);
+    if (nullptr == avformat_context)
+        throw std::runtime_error("thumbnails: cannot open the input");
+
+    int video_index = av_find_best_stream(avformat_context.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (video_index < 0)
+        throw std::runtime_error("thumbnails: no video stream");
+
+    //  the demuxer drops everything but the video keyframes, and the decoder skips the rest anyway
+    for (int index = 0; index < int(avformat_context->nb_streams); ++index)
+    {
+        if (index != video_index)
+            avformat_context->streams[index]->discard = AVDISCARD_ALL;
+        else
+            avformat_context->streams[index]->discard = AVDISCARD_NONKEY;
+    }
+
+    DecoderCodecContextDefinition decoder;
+    if (false == decoder.fill_stream_info(*avformat_context->streams[video_index], video_index))
+        throw std::runtime_error("thumbnails: cannot open the video decoder");
+    decoder.avcodec_context->skip_frame = AVDISCARD_NONKEY;
+
+    auto avcodec = codec_find_encoder(options.codec);
+    if (nullptr == avcodec)
+        throw std::runtime_error("thumbnails: no encoder " + options.codec);
+
+    uint64_t const sheet_slots = options.columns * options.rows;
+    //  one thumbnail per interval, the whole input is covered
+    uint64_t slot_count = probe.duration / options.interval;
+    if (0 == slot_count ||
+        probe.duration % options.interval)
+        ++slot_count;
+    //  resumes on a sheet boundary, as the library records whole sheets
+    uint64_t const first_slot = start / options.interval;
+    if (first_slot >= slot_count)
+        return result;
+
+    auto filter_graph = filter_graph_alloc();
+    AVFilterContext* filter_context_source = nullptr;
+    AVFilterContext* filter_context_sink = nullptr;
+
+    //  the graph is built on the first keyframe, when the decoded frame format is known
+    auto create_filter_graph = [&](AVFrame const& frame) -> bool
+    {
+        AVFilterContext* current = nullptr;
+        size_t filter_count = 0;
+
+        auto add_filter = [&](char const* name, string const& arguments) -> bool
+        {
+            AVFilterContext* context = nullptr;
+            string instance_name = string(name) + "_" + std::to_string(filter_count++);
+
+            if (0 > avfilter_graph_create_filter(&context,
+                                                 avfilter_get_by_name(name),
+                                                 instance_name.c_str(),
+                                                 arguments.empty() ? nullptr : arguments.c_str(),
+                                                 nullptr,
+                                                 filter_graph.get()))
+                return false;
+
+            if (current &&
+                0 > avfilter_link(current, 0, context, 0))
+                return false;
+
+            if (nullptr == filter_context_source)
+                filter_context_source = context;
+            current = context;
+
+            return true;
+        };
+
+        auto sar = frame.sample_aspect_ratio;
+        if (0 == sar.den)
+            sar = AVRational{0, 1};
+
+        string buffer_arguments;
+        buffer_arguments += "video_size=" + std::to_string(frame.width) + "x" +
+                                            std::to_string(frame.height);
+        buffer_arguments += ":pix_fmt=" + std::to_string(frame.format);
+        buffer_arguments += ":time_base=1/1000";
+        buffer_arguments += ":pixel_aspect=" + std::to_string(sar.num) +
+                            "/" + std::to_string(sar.den);
+
+        string width = std::to_string(options.width);
+        string height = std::to_string(options.height);
+
+        string pix_fmt = "yuv420p";
+        if (avcodec->pix_fmts)
+            pix_fmt = av_get_pix_fmt_name(avcodec->pix_fmts[0]);
+
+        if (false == add_filter("buffer", buffer_arguments))
+            return false;
+
+        rotation_angle angle = get_rotation(decoder.avstream.get(), 0);
+        if (angle == 90 &&
+            false == add_filter("transpose", "clock"))
+            return false;
+        else if (angle == 180 &&
+                 (false == add_filter("hflip", string()) ||
+                  false == add_filter("vflip", string())))
+            return false;
+        else if (angle == 270 &&
+                 false == add_filter("transpose", "cclock"))
+            return false;
+
+        //  the thumbnails keep the aspect ratio, and are centered within the tile
+        if (false == add_filter("scale", width + ":" + height + ":force_original_aspect_ratio=decrease:flags=bicubic") ||
+            false == add_filter("pad", width + ":" + height + ":(ow-iw)/2:(oh-ih)/2") ||
+            false == add_filter("setsar", "1") ||
+            false == add_filter("format", pix_fmt) ||
+            false == add_filter("tile", std::to_string(options.columns) + "x" + std::to_string(options.rows)) ||
+            false == add_filter("buffersink", string()))
+            return false;
+
+        filter_context_sink = current;
+
+        return 0 <= avfilter_graph_config(filter_graph.get(), nullptr);
+    };
+
+    auto frame = frame_alloc();
+    auto thumbnail = frame_alloc();
+    auto sheet = frame_alloc();
+    auto packet = packet_alloc();
+
+    //  decodes the first keyframe from the current read position
+    auto decode_keyframe = [&]() -> bool
+    {
+        bool flushing = false;
+        while (true)
+        {
+            int response = avcodec_receive_frame(decoder.avcodec_context.get(), frame.get());
+            if (0 == response)
+                return true;
+            if (response != AVERROR(EAGAIN) || flushing)
+                return false;
+
+            while (true)
+            {
+                if (0 > av_read_frame(avformat_context.get(), packet.get()))
+                {
+                    flushing = true;
+                    avcodec_send_packet(decoder.avcodec_context.get(), nullptr);
+                    break;
+                }
+
+                bool keyframe = (packet->stream_index == video_index &&
+                                 (packet->flags & AV_PKT_FLAG_KEY));
+                //  a broken keyframe is skipped for the next one
+                bool sent = (keyframe &&
+                             0 <= avcodec_send_packet(decoder.avcodec_context.get(), packet.get()));
+                packet_unref(packet);
+
+                if (sent)
+                    break;
+            }
+        }
+    };
+
+    auto encode_sheet = [&](cloudy::work_unit& work_unit) -> bool
+    {
+        auto avcodec_context = codec_context_alloc(avcodec);
+        if (nullptr == avcodec_context)
+            return false;
+
+        avcodec_context->width = sheet->width;
+        avcodec_context->height = sheet->height;
+        avcodec_context->pix_fmt = AVPixelFormat(sheet->format);
+        avcodec_context->sample_aspect_ratio = AVRational{1, 1};
+        avcodec_context->time_base = AVRational{1, 1000};
+
+        if (options.parameters)
+        for (auto const& item : *options.parameters)
+            av_opt_set(avcodec_context->priv_data, item.first.c_str(), item.second.c_str(), 0);
+
+        if (0 > avcodec_open2(avcodec_context.get(), avcodec.get(), nullptr))
+            return false;
+
+        sheet->pict_type = AV_PICTURE_TYPE_NONE;
+        if (0 > avcodec_send_frame(avcodec_context.get(), sheet.get()) ||
+            0 > avcodec_send_frame(avcodec_context.get(), nullptr))
+            return false;
+
+        filesystem::ofstream file;
+        file.open(work_unit.data_or_file, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        if (!file)
+            return false;
+
+        cloudy::stream_hash hash;
+        while (true)
+        {
+            int response = avcodec_receive_packet(avcodec_context.get(), packet.get());
+            if (response == AVERROR_EOF)
+                break;
+            if (response < 0)
+                return false;
+
+            file.write(reinterpret_cast<char const*>(packet->data), packet->size);
+            hash.update(reinterpret_cast<char const*>(packet->data), size_t(packet->size));
+            work_unit.data_size += uint64_t(packet->size);
+            packet_unref(packet);
+        }
+
+        file.close();
+        if (!file)
+            return false;
+
+        work_unit.data_hash = hash.result();
+
+        return true;
+    };
+
+    auto pull_sheets = [&]() -> bool
+    {
+        while (true)
+        {
+            frame_unref(sheet);
+            int response = av_buffersink_get_frame(filter_context_sink, sheet.get());
+            if (response == AVERROR(EAGAIN) ||
+                response == AVERROR_EOF)
+                return true;
+            else if (response < 0)
+                return false;
+
+            uint64_t sheet_start = (first_slot + result.size() * sheet_slots) * options.interval;
+            uint64_t sheet_end = std::min(first_slot + (result.size() + 1) * sheet_slots, slot_count) * options.interval;
+            if (probe.duration > sheet_start)
+                sheet_end = std::min(sheet_end, probe.duration);
+
+            string file_name = std::to_string(option_index) + "_" +
+                               std::to_string(first_slot / sheet_slots + result.size()) + "." +
+                               options.container_extension;
+
+            cloudy::work_unit work_unit;
+            work_unit.duration = sheet_end - sheet_start;
+            work_unit.result_type = InternalModel::ResultType::file;
+            work_unit.data_or_file = (output_dir / file_name).string();
+
+            result.push_back(work_unit);
+            if (false == encode_sheet(result.back()))
+                return false;
+        }
+    };
+
+    AVRational time_base = decoder.avstream->time_base;
+    int64_t thumbnail_timestamp = 0;
+    string error;
+
+    for (uint64_t slot = first_slot; error.empty() && slot != slot_count; ++slot)
+    {
+        int64_t target = int64_t(slot * options.interval);
+
+        //  the keyframe at or after the slot start, unless the previous one already got there.
+        //  the slots without a keyframe of their own repeat the last one
+        if (nullptr == thumbnail->buf[0] ||
+            thumbnail_timestamp < target)
+        {
+            int64_t timestamp = av_rescale_q(target, AVRational{1, 1000}, AV_TIME_BASE_Q);
+            if (0 <= avformat_seek_file(avformat_context.get(), -1, timestamp, timestamp, INT64_MAX, 0))
+                avcodec_flush_buffers(decoder.avcodec_context.get());
+
+            if (decode_keyframe())
+            {
+                int64_t pts = frame->best_effort_timestamp;
+                thumbnail_timestamp = (pts == AV_NOPTS_VALUE) ? target : timestamp_ms(pts, time_base);
+
+                frame_unref(thumbnail);
+                av_frame_move_ref(thumbnail.get(), frame.get());
+            }
+            else
+                thumbnail_timestamp = INT64_MAX;
+        }
+
+        if (nullptr == thumbnail->buf[0])
+        {
+            if (nullptr == filter_context_source)
+                error = "no keyframe could be decoded";
+            break;
+        }
+
+        if (nullptr == filter_context_source &&
+            false == create_filter_graph(*thumbnail))
+            error = "cannot create the filter graph";
+
+        thumbnail->pts = target;
+        if (error.empty() &&
+            (0 > av_buffersrc_add_frame_flags(filter_context_source, thumbnail.get(), AV_BUFFERSRC_FLAG_KEEP_REF) ||
+             false == pull_sheets()))
+            error = "cannot tile or encode the sheets";
+    }
+
+    //  the last sheet is written with the tiles it has
+    if (error.empty() &&
+        filter_context_source &&
+        (0 > av_buffersrc_add_frame_flags(filter_context_source, nullptr, 0) ||
+         false == pull_sheets()))
+        error = "cannot tile or encode the sheets";
+
+    if (false == error.empty())
+    {
+        for (auto const& work_unit : result)
+        {
+            boost::system::error_code ec;
+            filesystem::remove(work_unit.data_or_file, ec);
+        }
+        throw std::runtime_error("thumbnails: " + error);
+    }
+
+    return result;
+}
+
 transcoder::transcoder()
     : pimpl(new transcoder_detail())
 {}
 transcoder::~transcoder() = default;
 
+uint64_t transcoder::frames() const
+{
+    return pimpl->decoder.video_frames;
+}
+
+unordered_map<size_t, uint64_t> transcoder::encoded_frames() const
+{
+    return pimpl->encoded_frames();
+}
+
+transcode_timings transcoder::timings() const
+{
+    return pimpl->timings;
+}
+
 bool transcoder::init(vector<pair<AdminModel::MediaTypeDescriptionVariant, size_t>>& options)
 {
+    pimpl->decoder.start = int64_t(start);
+    pimpl->decoder.end = int64_t(end);
+    pimpl->decoder.accurate = accurate;
+    pimpl->decoder.probe_file = probe_file;
+    pimpl->decoder.timings = &pimpl->timings;
+
     if (false == pimpl->decoder.load(input_file.string()))
         return false;
 
@@ -1598,19 +3098,34 @@ bool transcoder::init(vector<pair<AdminModel::MediaTypeDescriptionVariant, size_
     for (auto& option : options)
     {
         EncoderContext encoder_context;
+        encoder_context.segment_duration = int64_t(segment_duration);
 
         if (false == encoder_context.load(option_index,
                                           option.first,
                                           pimpl->decoder,
-                                          output_dir))
+                                          output_dir,
+                                          output_suffix))
             return false;
 
+        encoder_context.timings = &pimpl->timings;
+        for (auto& encoder : encoder_context.definitions)
+            encoder.timings = &pimpl->timings;
+
         if (false == encoder_context.definitions.empty())
             pimpl->encoders.push_back(std::move(encoder_context));
 
         ++option_index;
     }
 
+    for (auto& encoder_context : pimpl->encoders)
+    for (auto& encoder : encoder_context.definitions)
+        encoder.owner = &encoder_context;
+
+    pimpl->share_audio_encoders();
+
+    pimpl->data_unit.more_read_packet = true;
+    pimpl->progress_reported = std::chrono::steady_clock::now();
+
     state = before_loop;
 
     return true;
@@ -1621,8 +3136,8 @@ unordered_map<size_t, cloudy::work_unit> transcoder::loop()
     unordered_map<size_t, cloudy::work_unit> result;
     bool code = true;
 
-    DataUnit data_unit;
-    data_unit.more_read_packet = true;
+    DataUnit& data_unit = pimpl->data_unit;
+    auto& progress_reported = pimpl->progress_reported;
 
     // may want to check if there are encoder_context.definitions
     // at all. and skip the whole decoding if there aren't any encoders
@@ -1645,24 +3160,65 @@ unordered_map<size_t, cloudy::work_unit> transcoder::loop()
             }
 
             if (false == data_unit.more_read_frame &&
-                false == data_unit.more_read_packet)
+                false == data_unit.more_read_packet &&
+                0 == segment_duration)
             {   //  on flush
                 auto& result_item = result[encoder_context.option_index];
                 result_item.duration = encoder_context.definitions.front().duration;
+                //  the parts of the same input have to add up, whatever the profile
+                if (end)
+                    result_item.duration = end - start;
                 result_item.result_type = InternalModel::ResultType::file;
                 result_item.data_or_file = encoder_context.filepath;
+                result_item.data_hash = encoder_context.output_hash;
+                result_item.data_size = encoder_context.output_size;
             }
         }
 
         data_unit.more_write_frame = false;
         data_unit.more_write_packet = false;
 
-        if (false == data_unit.more_read_packet)
+        if (false == code ||
+            false == data_unit.more_read_packet)
             break;
+
+        if (segment_duration)
+        {
+            result = pimpl->next_segment(true);
+            if (false == result.empty())
+                return result;
+        }
+
+        if (progress)
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (now - progress_reported >= std::chrono::milliseconds(progress_interval))
+            {
+                progress_reported = now;
+
+                transcode_progress value;
+                value.frames = pimpl->decoder.video_frames;
+                value.encoded_frames = pimpl->encoded_frames();
+                for (auto const& encoder_context : pimpl->encoders)
+                    value.positions[encoder_context.option_index] = encoder_context.definitions.front().duration;
+
+                progress(value);
+            }
+        }
     }
 
     if (false == code)
+    {
         result.clear();
+        for (auto& encoder_context : pimpl->encoders)
+            encoder_context.segments.clear();
+    }
+    else
+    {
+        pimpl->count_shared_audio();
+        if (segment_duration)
+            result = pimpl->next_segment(false);
+    }
 
     return result;
 }
@@ -1684,11 +3240,28 @@ transcoder::run()
     if (before_loop == state)
     {
         result = loop();
-        state = done;
+        //  the loop returns on every segment before the end of input
+        if (result.empty() ||
+            false == pimpl->data_unit.more_read_packet)
+            state = done;
     }
+    else if (done == state)
+        result = pimpl->next_segment(false);
+
     if (done == state)
         clean();
 
     return result;
 }
+
+uint64_t duration(filesystem::path const& input_file,
+                  filesystem::path const& probe_file)
+{
+    //  opened even with the cache, so that the cache is checked before the parts open the input
+    InternalModel::ProbeResult probe;
+    if (nullptr == format_context_alloc_input(input_file.string(), probe_file, probe))
+        return 0;
+
+    return probe.duration;
+}
 }
@@ -9,7 +9,9 @@
 
 #include <string>
 #include <vector>
+#include <chrono>
 #include <memory>
+#include <functional>
 #include <unordered_map>
 #include <utility>
 
@@ -21,7 +23,32 @@ namespace libavwrapper
 {
 class transcoder_detail;
 
-class transcoder
+//  how far the transcoder got, the output position of every option, in milliseconds
+//  from the start of the part, and the video frames every option has written
+class transcode_progress
+{
+public:
+    uint64_t frames = 0;
+    std::unordered_map<size_t, uint64_t> positions;
+    std::unordered_map<size_t, uint64_t> encoded_frames;
+};
+
+//  the time spent in every stage of the transcode, the audio shared among the profiles
+//  is counted once
+class transcode_timings
+{
+public:
+    std::chrono::steady_clock::duration demux = std::chrono::steady_clock::duration::zero();
+    std::chrono::steady_clock::duration decode = std::chrono::steady_clock::duration::zero();
+    std::chrono::steady_clock::duration filter = std::chrono::steady_clock::duration::zero();
+    std::chrono::steady_clock::duration encode = std::chrono::steady_clock::duration::zero();
+    std::chrono::steady_clock::duration mux = std::chrono::steady_clock::duration::zero();
+    //  the profiles that took the audio of another one, and the encode time that saved
+    uint64_t shared_audio = 0;
+    std::chrono::steady_clock::duration shared_audio_saved = std::chrono::steady_clock::duration::zero();
+};
+
+class CLOUDYSERVERSHARED_EXPORT transcoder
 {
 private:
     enum e_state {before_init, before_loop, done};
@@ -36,8 +63,46 @@ public:
     ~transcoder();
     boost::filesystem::path input_file;
     boost::filesystem::path output_dir;
+    //  the part of the input to transcode, in milliseconds, see split_parts
+    uint64_t start = 0;
+    uint64_t end = 0;
+    //  the part start is not on a keyframe, the frames before it are decoded and dropped
+    bool accurate = false;
+    //  in milliseconds, every option is cut into segments on the multiples of it from the
+    //  start of input, each starting with a keyframe. run returns the segments one at a time
+    uint64_t segment_duration = 0;
+    //  where the probe results of the input are cached, empty for no cache
+    boost::filesystem::path probe_file;
+    //  keeps the output files of the parts apart
+    std::string output_suffix;
+    //  called from run, at most once per progress_interval milliseconds, run waits while it blocks
+    std::function<void(transcode_progress const&)> progress;
+    uint64_t progress_interval = 1000;
 
     bool init(std::vector<std::pair<AdminModel::MediaTypeDescriptionVariant, size_t>>& options);
     std::unordered_map<size_t, cloudy::work_unit> run();
+    //  the video frames decoded so far, the copied streams are not decoded
+    uint64_t frames() const;
+    //  the video frames written for every option, encoded or copied
+    std::unordered_map<size_t, uint64_t> encoded_frames() const;
+    transcode_timings timings() const;
 };
+
+//  splits the input on the video keyframes, into parts of at least part_duration milliseconds
+//  to transcode independently. zero end of a part means the end of input
+std::vector<std::pair<uint64_t, uint64_t>> split_parts(boost::filesystem::path const& input_file,
+                                                       boost::filesystem::path const& probe_file,
+                                                       uint64_t part_duration);
+//  tiles the video keyframes, one per options.interval milliseconds, into the image sheets.
+//  only the keyframes are decoded. the sheets before start are not generated again.
+//  throws with the reason if the sheets can't be made, nothing is left on disk then
+std::vector<cloudy::work_unit> thumbnails(boost::filesystem::path const& input_file,
+                                          boost::filesystem::path const& probe_file,
+                                          boost::filesystem::path const& output_dir,
+                                          size_t option_index,
+                                          AdminModel::MediaTypeDescriptionThumbnails const& options,
+                                          uint64_t start);
+//  the duration of the input in milliseconds, zero if not known
+CLOUDYSERVERSHARED_EXPORT uint64_t duration(boost::filesystem::path const& input_file,
+                                            boost::filesystem::path const& probe_file);
 }
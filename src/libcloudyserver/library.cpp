@@ -5,8 +5,12 @@
 #include <mesh.pp/fileutility.hpp>
 #include <mesh.pp/cryptoutility.hpp>
 
+#include <boost/filesystem.hpp>
+
 #include <unordered_map>
+#include <map>
 #include <algorithm>
+#include <chrono>
 
 using beltpp::packet;
 namespace filesystem = boost::filesystem;
@@ -16,6 +20,8 @@ using std::pair;
 using std::unordered_set;
 using std::unordered_map;
 using boost::optional;
+namespace chrono = std::chrono;
+using chrono::system_clock;
 
 namespace cloudy
 {
@@ -25,9 +31,10 @@ namespace detail
 class library_internal
 {
 public:
-    library_internal(filesystem::path const& path)
+    library_internal(filesystem::path const& path, uint64_t _index_concurrency)
         : processing_for_check(false)
         , processing_for_index(0)
+        , index_concurrency(_index_concurrency)
         , library_tree("library_tree", path, 10000, get_internal_putl())
         , library_index("library_index", path, 10000, get_admin_putl())
         , pending_for_index(path / "pending_for_index.json")
@@ -35,21 +42,44 @@ public:
     {}
 
     bool processing_for_check;
+    //  the first processing_for_index items of pending_for_index are being processed
     uint64_t processing_for_index;
+    uint64_t index_concurrency;
     meshpp::map_loader<LibraryTree> library_tree;
     meshpp::map_loader<AdminModel::LibraryIndex> library_index;
-    meshpp::file_loader<PendingForIndex,
-                        &PendingForIndex::from_string,
-                        &PendingForIndex::to_string> pending_for_index;
-    meshpp::file_loader<PendingForMediaCheck,
-                        &PendingForMediaCheck::from_string,
-                        &PendingForMediaCheck::to_string> pending_for_media_check;
+    tracked_file_loader<meshpp::file_loader<PendingForIndex,
+                                            &PendingForIndex::from_string,
+                                            &PendingForIndex::to_string>> pending_for_index;
+    tracked_file_loader<meshpp::file_loader<PendingForMediaCheck,
+                                            &PendingForMediaCheck::from_string,
+                                            &PendingForMediaCheck::to_string>> pending_for_media_check;
 };
 }
 
-library::library(boost::filesystem::path const& path)
-    : m_pimpl(new detail::library_internal(path))
+library::library(boost::filesystem::path const& path, uint64_t index_concurrency)
+    : m_pimpl(new detail::library_internal(path, index_concurrency))
 {
+    if (0 == index_concurrency)
+        throw std::runtime_error("library::library: 0 == index_concurrency");
+
+    //  the hashed items are waiting for media check, the rest will be hashed again
+    auto const& items = m_pimpl->pending_for_index.as_const()->items;
+    auto it_hashed = std::find_if(items.begin(), items.end(), [](PendingForIndexItem const& item)
+    {
+        return item.sha256sum.empty();
+    });
+    if (std::any_of(it_hashed, items.end(), [](PendingForIndexItem const& item)
+                    {
+                        return false == item.sha256sum.empty();
+                    }))
+    {
+        auto& mutable_items = m_pimpl->pending_for_index->items;
+        std::stable_partition(mutable_items.begin(), mutable_items.end(), [](PendingForIndexItem const& item)
+        {
+            return false == item.sha256sum.empty();
+        });
+    }
+
     for (auto const& item : m_pimpl->pending_for_index.as_const()->items)
     {
         if (false == item.sha256sum.empty())
@@ -78,7 +108,7 @@ void library::commit() noexcept
 void library::discard() noexcept
 {
     m_pimpl->pending_for_index.discard();
-    m_pimpl->pending_for_media_check.commit();
+    m_pimpl->pending_for_media_check.discard();
     m_pimpl->library_tree.discard();
     m_pimpl->library_index.discard();
 }
@@ -89,6 +119,18 @@ void library::clear()
     m_pimpl->library_tree.clear();
     m_pimpl->library_index.clear();
 }
+save_statistics library::statistics() const
+{
+    save_statistics result;
+    for (auto const* pstatistics : {&m_pimpl->pending_for_index.statistics,
+                                    &m_pimpl->pending_for_media_check.statistics})
+    {
+        result.files += pstatistics->files;
+        result.bytes += pstatistics->bytes;
+    }
+
+    return result;
+}
 
 AdminModel::LibraryResponse library::list(vector<string> const& path) const
 {
@@ -272,13 +314,20 @@ vector<string> library::delete_library(vector<string> const& path)
 }
 
 bool library::index(vector<string>&& path,
-                    std::unordered_set<AdminModel::MediaTypeDescriptionVariant>&& type_descriptions)
+                    std::unordered_set<AdminModel::MediaTypeDescriptionVariant>&& type_descriptions,
+                    uint64_t priority)
 {
     string path_string = join_path(path).first;
 
     PendingForIndexItem item;
     item.path = std::move(path);
     item.type_descriptions = std::move(type_descriptions);
+    item.priority = priority;
+
+    boost::system::error_code ec;
+    auto size = filesystem::file_size(check_path(item.path).first, ec);
+    if (!ec)
+        item.size = size;
 #if 0
     using FilterVariant = AdminModel::variant_type<AdminModel::MediaTypeDescriptionVideoFilter::rtt, AdminModel::MediaTypeDescriptionAudioFilter::rtt>;
     using TypeDescVariant = AdminModel::variant_type<AdminModel::MediaTypeDescriptionAVContainer::rtt, AdminModel::MediaTypeDescriptionRaw::rtt>;
@@ -396,8 +445,7 @@ bool library::index(vector<string>&& path,
     }
 #endif
 
-    auto& pending_items = m_pimpl->pending_for_index->items;
-    for (auto const& pending_item : pending_items)
+    for (auto const& pending_item : m_pimpl->pending_for_index.as_const()->items)
     {
         if (pending_item.path == item.path)
         {
@@ -409,7 +457,7 @@ bool library::index(vector<string>&& path,
     if (item.type_descriptions.empty())
         return false;
 
-    pending_items.push_back(std::move(item));
+    m_pimpl->pending_for_index->items.push_back(std::move(item));
 
     return true;
 }
@@ -419,18 +467,59 @@ vector<pair<vector<string>, unordered_set<AdminModel::MediaTypeDescriptionVarian
     vector<pair<vector<string>, unordered_set<AdminModel::MediaTypeDescriptionVariant>>> result;
 
     auto const& pending_items = m_pimpl->pending_for_index.as_const()->items;
-    for (size_t index = 0; index != pending_items.size(); ++index)
+
+    //  the hashed items in processing are waiting for media check, those are not counted
+    uint64_t hashing = 0;
+    for (size_t index = 0; index != m_pimpl->processing_for_index; ++index)
     {
-        if (m_pimpl->processing_for_index == 3)
-            break;
+        if (pending_items[index].sha256sum.empty())
+            ++hashing;
+    }
 
-        if (index == m_pimpl->processing_for_index)
+    while (hashing < m_pimpl->index_concurrency &&
+           m_pimpl->processing_for_index < pending_items.size())
+    {
+        //  higher priority first, then the smaller file first.
+        //  but the oldest item that was overtaken too many times goes before all
+        size_t selected = m_pimpl->processing_for_index;
+        for (size_t index = m_pimpl->processing_for_index; index != pending_items.size(); ++index)
         {
-            ++m_pimpl->processing_for_index;
+            auto const& item = pending_items[index];
+            auto const& selected_item = pending_items[selected];
 
-            result.push_back(std::make_pair(pending_items[index].path,
-                                            pending_items[index].type_descriptions));
+            if (item.bypassed && *item.bypassed >= index_fairness_cap)
+            {
+                selected = index;
+                break;
+            }
+
+            uint64_t priority = item.priority ? *item.priority : default_priority;
+            uint64_t selected_priority = selected_item.priority ? *selected_item.priority : default_priority;
+            uint64_t size = item.size ? *item.size : 0;
+            uint64_t selected_size = selected_item.size ? *selected_item.size : 0;
+
+            if (priority > selected_priority ||
+                (priority == selected_priority && size < selected_size))
+                selected = index;
+        }
+
+        auto& items = m_pimpl->pending_for_index->items;
+        for (size_t index = m_pimpl->processing_for_index; index != selected; ++index)
+        {
+            auto& item = items[index];
+            item.bypassed = (item.bypassed ? *item.bypassed : 0) + 1;
         }
+        items[selected].bypassed = boost::none;
+
+        std::rotate(items.begin() + m_pimpl->processing_for_index,
+                    items.begin() + selected,
+                    items.begin() + selected + 1);
+
+        auto const& item = items[m_pimpl->processing_for_index];
+        result.push_back(std::make_pair(item.path, item.type_descriptions));
+
+        ++m_pimpl->processing_for_index;
+        ++hashing;
     }
 
     return result;
@@ -465,8 +554,7 @@ unordered_set<AdminModel::MediaTypeDescriptionVariant> library::process_index_st
 
 string library::process_index_retrieve_hash(vector<string> const& path) const
 {
-    auto& items = m_pimpl->pending_for_index->items;
-    for (auto& item : items)
+    for (auto const& item : m_pimpl->pending_for_index.as_const()->items)
     {
         if (item.path == path)
             return item.sha256sum;
@@ -520,8 +608,7 @@ bool library::check(vector<string>&& path, unordered_set<AdminModel::MediaTypeDe
 {
     auto type_descriptions_temp = type_descriptions;
 
-    auto& pending_items = m_pimpl->pending_for_media_check->items;
-    for (auto const& pending_item : pending_items)
+    for (auto const& pending_item : m_pimpl->pending_for_media_check.as_const()->items)
     {
         if (pending_item.path == path)
         {
@@ -536,8 +623,21 @@ bool library::check(vector<string>&& path, unordered_set<AdminModel::MediaTypeDe
     ProcessMediaCheckRequest check;
     check.path = std::move(path);
     check.type_descriptions = std::move(type_descriptions_temp);
+    check.enqueued.emplace();
+    check.enqueued->tm = system_clock::to_time_t(system_clock::now());
     process_index_update(check.path, type_descriptions, check.type_descriptions);
-    pending_items.push_back(check);
+
+    for (auto const& item : m_pimpl->pending_for_index.as_const()->items)
+    {
+        if (item.path == check.path)
+        {
+            check.priority = item.priority;
+            check.sha256sum = item.sha256sum;
+            break;
+        }
+    }
+
+    m_pimpl->pending_for_media_check->items.push_back(check);
 
     return true;
 }
@@ -546,15 +646,51 @@ vector<ProcessMediaCheckRequest> library::process_check()
 {
     vector<ProcessMediaCheckRequest> result;
 
-    for (InternalModel::ProcessMediaCheckRequest const& item : m_pimpl->pending_for_media_check.as_const()->items)
+    auto const& items = m_pimpl->pending_for_media_check.as_const()->items;
+    if (m_pimpl->processing_for_check || items.empty())
+        return result;
+
+    //  pick by priority, then by age. waiting raises the priority, so nothing starves
+    auto now = system_clock::now();
+    size_t selected = 0;
+    uint64_t selected_priority = 0;
+    for (size_t index = 0; index != items.size(); ++index)
     {
-        if (m_pimpl->processing_for_check)
-            break;
-        m_pimpl->processing_for_check = true;
+        auto const& item = items[index];
+
+        uint64_t priority = item.priority ? *item.priority : default_priority;
+        if (item.enqueued)
+        {
+            auto waiting = now - system_clock::from_time_t(item.enqueued->tm);
+            if (waiting > system_clock::duration::zero())
+            {
+                //  saturating, the priorities come from the users
+                uint64_t aging = uint64_t(waiting / priority_aging_period);
+                priority = (priority > uint64_t(-1) - aging) ? uint64_t(-1) : priority + aging;
+            }
+        }
+        else
+            priority = uint64_t(-1); // queued before priorities existed, keep these first
+
+        if (0 == index || priority > selected_priority)
+        {
+            selected = index;
+            selected_priority = priority;
+        }
+    }
 
-        result.push_back(item);
+    //  the item being processed is always kept in front
+    if (selected != 0)
+    {
+        auto& mutable_items = m_pimpl->pending_for_media_check->items;
+        std::rotate(mutable_items.begin(),
+                    mutable_items.begin() + selected,
+                    mutable_items.begin() + selected + 1);
     }
 
+    m_pimpl->processing_for_check = true;
+    result.push_back(m_pimpl->pending_for_media_check.as_const()->items.front());
+
     return result;
 }
 
@@ -574,6 +710,29 @@ void library::process_check_done_part(ProcessMediaCheckResult&& progress_item,
         {
             if (progress_item.count)
             {
+                if (progress_item.type_description)
+                {
+                    if (!item.progress)
+                        item.progress = vector<InternalModel::MediaCheckProgress>();
+
+                    InternalModel::MediaCheckProgress* pprogress = nullptr;
+                    for (auto& progress : *item.progress)
+                    {
+                        if (progress.type_description == *progress_item.type_description)
+                            pprogress = &progress;
+                    }
+                    if (nullptr == pprogress)
+                    {
+                        item.progress->push_back(InternalModel::MediaCheckProgress());
+                        pprogress = &item.progress->back();
+                        pprogress->type_description = *progress_item.type_description;
+                    }
+
+                    pprogress->accumulated = progress_item.accumulated + progress_item.count;
+                }
+                if (progress_item.resume)
+                    item.resume = *progress_item.resume;
+
                 string sha256sum = process_index_retrieve_hash(progress_item.path);
 
                 add(std::move(progress_item), uri, sha256sum);
@@ -591,12 +750,12 @@ library::process_check_get_pending(ProcessMediaCheckResult const& progress_item)
 {
     string string_path = join_path(progress_item.path).first;
 
-    auto& items = m_pimpl->pending_for_media_check->items;
+    auto const& items = m_pimpl->pending_for_media_check.as_const()->items;
 
     auto it_item = items.begin();
     if (it_item != items.end())
     {
-        InternalModel::ProcessMediaCheckRequest& item = *it_item;
+        InternalModel::ProcessMediaCheckRequest const& item = *it_item;
 
         if (item.path == progress_item.path)
         {
@@ -657,6 +816,31 @@ void library::process_check_done(ProcessMediaCheckResult const& progress_item,
     throw std::logic_error("library::process_check_done: pending item not found");
 }
 
+AdminModel::QueueStatus library::queue() const
+{
+    std::map<uint64_t, AdminModel::QueueDepth> depths;
+
+    for (auto const& item : m_pimpl->pending_for_index.as_const()->items)
+    {
+        uint64_t priority = item.priority ? *item.priority : default_priority;
+        ++depths[priority].pending_for_index;
+    }
+    for (auto const& item : m_pimpl->pending_for_media_check.as_const()->items)
+    {
+        uint64_t priority = item.priority ? *item.priority : default_priority;
+        ++depths[priority].pending_for_media_check;
+    }
+
+    AdminModel::QueueStatus result;
+    for (auto& depth : depths)
+    {
+        depth.second.priority = depth.first;
+        result.depths.push_back(std::move(depth.second));
+    }
+
+    return result;
+}
+
 AdminModel::IndexListResponse library::list_index(std::string const& sha256sum) const
 {
     AdminModel::IndexListResponse result;
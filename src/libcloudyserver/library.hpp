@@ -26,6 +26,7 @@ class ProcessMediaCheckResult;
 namespace AdminModel
 {
 class IndexListResponse;
+class QueueStatus;
 }
 
 namespace cloudy
@@ -35,17 +36,19 @@ namespace detail
 {
 class library_internal;
 }
+class save_statistics;
 
-class library
+class CLOUDYSERVERSHARED_EXPORT library
 {
 public:
-    library(boost::filesystem::path const& path);
+    library(boost::filesystem::path const& path, uint64_t index_concurrency);
     ~library();
 
     void save();
     void commit() noexcept;
     void discard() noexcept;
     void clear();
+    save_statistics statistics() const;
 
     AdminModel::LibraryResponse list(std::vector<std::string> const& path) const;
     beltpp::packet info(std::vector<std::string> const& path) const;
@@ -54,7 +57,9 @@ public:
              std::string const& sha256sum);
     std::vector<std::string> delete_library(std::vector<std::string> const& path);
 
-    bool index(std::vector<std::string>&& path, std::unordered_set<AdminModel::MediaTypeDescriptionVariant>&& type_descriptions);
+    bool index(std::vector<std::string>&& path,
+               std::unordered_set<AdminModel::MediaTypeDescriptionVariant>&& type_descriptions,
+               uint64_t priority);
     std::vector<std::pair<std::vector<std::string>, std::unordered_set<AdminModel::MediaTypeDescriptionVariant>>> process_index();
     std::unordered_set<AdminModel::MediaTypeDescriptionVariant>
     process_index_store_hash(std::vector<std::string> const& path,
@@ -77,6 +82,8 @@ public:
 
     void process_check_done(InternalModel::ProcessMediaCheckResult const& item, bool allow_throw);
 
+    AdminModel::QueueStatus queue() const;
+
     AdminModel::IndexListResponse list_index(std::string const& sha256sum) const;
     std::vector<std::string> delete_index(std::string const& sha256sum,
                                           std::vector<std::string> const& only_path = std::vector<std::string>());
@@ -0,0 +1,317 @@
+#include "metrics.hpp"
+
+#include <array>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <stdexcept>
+
+namespace chrono = std::chrono;
+using std::string;
+using std::vector;
+using std::unordered_set;
+using std::unordered_map;
+
+namespace cloudy
+{
+namespace metrics
+{
+namespace detail
+{
+size_t const max_slots = 4096;
+
+double const bucket_bounds[] = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60};
+char const* const bucket_labels[] = {"0.001", "0.0025", "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "0.5", "1", "2.5", "5", "10", "30", "60"};
+size_t const bucket_count = sizeof(bucket_bounds) / sizeof(bucket_bounds[0]);
+//  the buckets, the one above all the bounds, and the sum in microseconds
+size_t const histogram_slots = bucket_count + 2;
+
+enum class metric_type {counter, gauge, histogram};
+
+class descriptor
+{
+public:
+    string name;
+    string help;
+    string labels;
+    metric_type type;
+    size_t slot;
+    std::atomic<int64_t>* pgauge;
+};
+
+class thread_values;
+
+class registry
+{
+public:
+    std::mutex mutex;
+    std::deque<descriptor> descriptors;
+    size_t slots_used = 0;
+    std::deque<std::atomic<int64_t>> gauges;
+    unordered_set<thread_values*> threads;
+    //  what the finished threads have left
+    std::array<uint64_t, max_slots> retired = std::array<uint64_t, max_slots>();
+
+    descriptor const& add(string const& name,
+                          string const& help,
+                          string const& labels,
+                          metric_type type)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto const& item : descriptors)
+        {
+            if (item.name == name && item.labels == labels)
+            {
+                if (item.type != type)
+                    throw std::logic_error("metrics::registry::add: item.type != type, " + name);
+                return item;
+            }
+        }
+
+        descriptor item;
+        item.name = name;
+        item.help = help;
+        item.labels = labels;
+        item.type = type;
+        item.slot = slots_used;
+        item.pgauge = nullptr;
+
+        if (type == metric_type::gauge)
+        {
+            gauges.emplace_back(0);
+            item.pgauge = &gauges.back();
+        }
+        else
+        {
+            size_t count = (type == metric_type::histogram) ? histogram_slots : 1;
+            if (slots_used + count > max_slots)
+                throw std::runtime_error("metrics: too many metrics, " + name);
+            slots_used += count;
+        }
+
+        descriptors.push_back(std::move(item));
+        return descriptors.back();
+    }
+
+    uint64_t value(size_t slot) const;
+};
+
+registry& get_registry()
+{
+    //  never destroyed, the threads may still update the metrics at exit
+    static registry* pinstance = new registry();
+    return *pinstance;
+}
+
+class thread_values
+{
+public:
+    thread_values()
+    {
+        for (auto& item : values)
+            item.store(0, std::memory_order_relaxed);
+
+        auto& instance = get_registry();
+        std::lock_guard<std::mutex> lock(instance.mutex);
+        instance.threads.insert(this);
+    }
+    ~thread_values()
+    {
+        auto& instance = get_registry();
+        std::lock_guard<std::mutex> lock(instance.mutex);
+        instance.threads.erase(this);
+
+        for (size_t index = 0; index != max_slots; ++index)
+            instance.retired[index] += values[index].load(std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, max_slots> values;
+};
+
+//  called with the mutex locked
+uint64_t registry::value(size_t slot) const
+{
+    uint64_t result = retired[slot];
+    for (auto const* pthread : threads)
+        result += pthread->values[slot].load(std::memory_order_relaxed);
+
+    return result;
+}
+
+//  only the owning thread writes, the scrape reads
+void add(size_t slot, uint64_t value)
+{
+    thread_local thread_values this_thread;
+
+    auto& item = this_thread.values[slot];
+    item.store(item.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+string with_labels(string const& labels, string const& more)
+{
+    if (labels.empty() && more.empty())
+        return string();
+    if (labels.empty() || more.empty())
+        return "{" + labels + more + "}";
+    return "{" + labels + "," + more + "}";
+}
+}
+
+counter::counter(string const& name,
+                 string const& help,
+                 string const& labels)
+    : slot(detail::get_registry().add(name, help, labels, detail::metric_type::counter).slot)
+{}
+
+void counter::add(uint64_t value) const
+{
+    detail::add(slot, value);
+}
+
+gauge::gauge(string const& name,
+             string const& help,
+             string const& labels)
+    : pvalue(detail::get_registry().add(name, help, labels, detail::metric_type::gauge).pgauge)
+{}
+
+void gauge::set(int64_t value) const
+{
+    pvalue->store(value, std::memory_order_relaxed);
+}
+
+void gauge::add(int64_t value) const
+{
+    pvalue->fetch_add(value, std::memory_order_relaxed);
+}
+
+histogram::histogram(string const& name,
+                     string const& help,
+                     string const& labels)
+    : slot(detail::get_registry().add(name, help, labels, detail::metric_type::histogram).slot)
+{}
+
+void histogram::observe(chrono::steady_clock::duration const& value) const
+{
+    auto microseconds = chrono::duration_cast<chrono::microseconds>(value).count();
+    if (microseconds < 0)
+        microseconds = 0;
+
+    double seconds = double(microseconds) / 1000000;
+
+    size_t bucket = 0;
+    while (bucket != detail::bucket_count &&
+           seconds > detail::bucket_bounds[bucket])
+        ++bucket;
+
+    detail::add(slot + bucket, 1);
+    detail::add(slot + detail::bucket_count + 1, uint64_t(microseconds));
+}
+
+route::route(string const& server, string const& name)
+    : requests("cloudy_http_requests_total",
+               "http requests handled, by route",
+               "server=\"" + server + "\",route=\"" + name + "\"")
+    , latency("cloudy_http_request_duration_seconds",
+              "http request handling time, by route",
+              "server=\"" + server + "\",route=\"" + name + "\"")
+{}
+
+void route::observe(chrono::steady_clock::duration const& value) const
+{
+    requests.add();
+    latency.observe(value);
+}
+
+timer::timer(histogram const& _target)
+    : target(_target)
+    , start(chrono::steady_clock::now())
+{}
+
+timer::~timer()
+{
+    target.observe(chrono::steady_clock::now() - start);
+}
+
+scoped_increment::scoped_increment(gauge const& _target)
+    : target(_target)
+{
+    target.add(1);
+}
+
+scoped_increment::~scoped_increment()
+{
+    target.add(-1);
+}
+
+string scrape()
+{
+    auto& instance = detail::get_registry();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+
+    //  the metrics with the same name are listed together, under a single help
+    vector<string> names;
+    unordered_map<string, vector<detail::descriptor const*>> by_name;
+    for (auto const& item : instance.descriptors)
+    {
+        auto& same_name = by_name[item.name];
+        if (same_name.empty())
+            names.push_back(item.name);
+        same_name.push_back(&item);
+    }
+
+    string result;
+    for (auto const& name : names)
+    {
+        auto const& same_name = by_name[name];
+        auto type = same_name.front()->type;
+
+        result += "# HELP " + name + " " + same_name.front()->help + "\n";
+        if (type == detail::metric_type::counter)
+            result += "# TYPE " + name + " counter\n";
+        else if (type == detail::metric_type::gauge)
+            result += "# TYPE " + name + " gauge\n";
+        else
+            result += "# TYPE " + name + " histogram\n";
+
+        for (auto const* pitem : same_name)
+        {
+            auto const& item = *pitem;
+
+            if (type == detail::metric_type::counter)
+                result += name + detail::with_labels(item.labels, string()) + " " +
+                          std::to_string(instance.value(item.slot)) + "\n";
+            else if (type == detail::metric_type::gauge)
+                result += name + detail::with_labels(item.labels, string()) + " " +
+                          std::to_string(item.pgauge->load(std::memory_order_relaxed)) + "\n";
+            else
+            {
+                uint64_t count = 0;
+                for (size_t bucket = 0; bucket != detail::bucket_count; ++bucket)
+                {
+                    count += instance.value(item.slot + bucket);
+                    result += name + "_bucket" +
+                              detail::with_labels(item.labels, string("le=\"") + detail::bucket_labels[bucket] + "\"") +
+                              " " + std::to_string(count) + "\n";
+                }
+                count += instance.value(item.slot + detail::bucket_count);
+                result += name + "_bucket" + detail::with_labels(item.labels, "le=\"+Inf\"") +
+                          " " + std::to_string(count) + "\n";
+
+                uint64_t microseconds = instance.value(item.slot + detail::bucket_count + 1);
+                result += name + "_sum" + detail::with_labels(item.labels, string()) + " " +
+                          std::to_string(microseconds / 1000000) + "." +
+                          std::to_string(1000000 + microseconds % 1000000).substr(1) + "\n";
+                result += name + "_count" + detail::with_labels(item.labels, string()) + " " +
+                          std::to_string(count) + "\n";
+            }
+        }
+    }
+
+    return result;
+}
+}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "global.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+namespace cloudy
+{
+namespace metrics
+{
+//  the counters and histograms are kept per thread and summed up on scrape,
+//  so the thread updating them never locks. the same name and labels give
+//  the same metric, registration is the only place that locks
+class counter
+{
+public:
+    counter(std::string const& name,
+            std::string const& help,
+            std::string const& labels = std::string());
+
+    void add(uint64_t value = 1) const;
+private:
+    size_t slot;
+};
+
+//  a single value for the whole process
+class gauge
+{
+public:
+    gauge(std::string const& name,
+          std::string const& help,
+          std::string const& labels = std::string());
+
+    void set(int64_t value) const;
+    void add(int64_t value) const;
+private:
+    std::atomic<int64_t>* pvalue;
+};
+
+//  durations, in seconds on scrape
+class histogram
+{
+public:
+    histogram(std::string const& name,
+              std::string const& help,
+              std::string const& labels = std::string());
+
+    void observe(std::chrono::steady_clock::duration const& value) const;
+private:
+    size_t slot;
+};
+
+//  the request count and latency of a route of the http server
+class route
+{
+public:
+    route(std::string const& server, std::string const& name);
+
+    void observe(std::chrono::steady_clock::duration const& value) const;
+private:
+    counter requests;
+    histogram latency;
+};
+
+//  observes the time until the end of scope
+class timer
+{
+public:
+    explicit timer(histogram const& target);
+    ~timer();
+
+    timer(timer const&) = delete;
+    timer& operator = (timer const&) = delete;
+private:
+    histogram const& target;
+    std::chrono::steady_clock::time_point start;
+};
+
+//  adds one to the gauge until the end of scope
+class scoped_increment
+{
+public:
+    explicit scoped_increment(gauge const& target);
+    ~scoped_increment();
+
+    scoped_increment(scoped_increment const&) = delete;
+    scoped_increment& operator = (scoped_increment const&) = delete;
+private:
+    gauge const& target;
+};
+
+//  all the metrics of the process, in prometheus text format
+CLOUDYSERVERSHARED_EXPORT std::string scrape();
+}
+}
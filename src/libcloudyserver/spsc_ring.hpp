@@ -0,0 +1,130 @@
+#pragma once
+
+#include "global.hpp"
+
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <stdexcept>
+
+namespace cloudy
+{
+//  bounded lock-free queue between exactly one producer thread and one consumer thread.
+//  the consumer is woken only when the queue turns non empty, so a burst costs a single
+//  wake-up. the producer that finds the queue full is woken once there is room again
+template <typename T>
+class spsc_ring
+{
+public:
+    explicit spsc_ring(size_t capacity = 1024)
+        : slots(capacity)
+        , head(0)
+        , tail(0)
+        , count(0)
+        , producer_waiting(false)
+        , pushed(0)
+        , consumer_wakes(0)
+    {
+        if (0 == capacity)
+            throw std::logic_error("spsc_ring::spsc_ring: 0 == capacity");
+    }
+
+    spsc_ring(spsc_ring const&) = delete;
+    spsc_ring& operator = (spsc_ring const&) = delete;
+
+    //  both are set before the threads start
+    void set_consumer_wake(std::function<void()> const& wake)
+    {
+        wake_consumer = wake;
+    }
+    void set_producer_wake(std::function<void()> const& wake)
+    {
+        wake_producer = wake;
+    }
+
+    //  producer side, the item is left untouched if the queue is full
+    bool push(T&& item)
+    {
+        if (count.load(std::memory_order_acquire) == slots.size())
+        {
+            producer_waiting.store(true);
+            if (count.load() == slots.size())
+                return false;
+            producer_waiting.store(false, std::memory_order_relaxed);
+        }
+
+        slots[tail] = std::move(item);
+        tail = (tail + 1) % slots.size();
+
+        pushed.store(pushed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        if (0 == count.fetch_add(1, std::memory_order_acq_rel))
+        {
+            consumer_wakes.store(consumer_wakes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (wake_consumer)
+                wake_consumer();
+        }
+
+        return true;
+    }
+
+    //  consumer side, appends everything available to items. the queue is left empty
+    //  so the next push wakes the consumer again
+    template <typename T_container>
+    size_t pop_all(T_container& items)
+    {
+        size_t result = 0;
+        size_t available = count.load(std::memory_order_acquire);
+
+        while (available)
+        {
+            for (size_t index = 0; index != available; ++index)
+            {
+                items.push_back(std::move(slots[head]));
+                slots[head] = T();
+                head = (head + 1) % slots.size();
+            }
+
+            result += available;
+            available = count.fetch_sub(available) - available;
+        }
+
+        if (result &&
+            producer_waiting.exchange(false) &&
+            wake_producer)
+            wake_producer();
+
+        return result;
+    }
+
+    size_t capacity() const
+    {
+        return slots.size();
+    }
+
+    //  for the statistics, wakes per pushed item
+    uint64_t pushed_count() const
+    {
+        return pushed.load(std::memory_order_relaxed);
+    }
+    uint64_t wake_count() const
+    {
+        return consumer_wakes.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<T> slots;
+    //  owned by the consumer
+    size_t head;
+    //  owned by the producer
+    size_t tail;
+    std::atomic<size_t> count;
+    std::atomic<bool> producer_waiting;
+    std::atomic<uint64_t> pushed;
+    std::atomic<uint64_t> consumer_wakes;
+    std::function<void()> wake_consumer;
+    std::function<void()> wake_producer;
+};
+}
@@ -1,5 +1,7 @@
 #include "storage.hpp"
 #include "common.hpp"
+#include "hash.hpp"
+#include "metrics.hpp"
 
 #include <mesh.pp/fileutility.hpp>
 #include <mesh.pp/cryptoutility.hpp>
@@ -9,10 +11,14 @@
 #include <boost/filesystem.hpp>
 
 #include <string>
+#include <vector>
+#include <utility>
 
 namespace filesystem = boost::filesystem;
 using std::string;
 using std::unordered_set;
+using std::vector;
+using std::pair;
 
 namespace cloudy
 {
@@ -28,9 +34,136 @@ public:
         , path_binaries(_path_binaries)
     {}
 
+    //  the map changes below are saved and committed by the caller
+    uint64_t add(string const& uri, StorageModel::StorageFile& file)
+    {
+        if (map.contains(uri))
+        {
+            auto& duplicate_count = map.at(uri).duplicate_count;
+            ++duplicate_count;
+            return duplicate_count;
+        }
+        else if (map.insert(uri, file))
+            return 1;
+        else
+            throw std::logic_error("storage::put: false == map.insert(uri, file)");
+    }
+
+    uint64_t add_data(StorageModel::StorageFile&& file, string& uri)
+    {
+        uri = meshpp::hash(file.data);
+        file.data = meshpp::to_base64(file.data, true);
+        file.duplicate_count = 1;
+
+        return add(uri, file);
+    }
+
+    //  the inlined files are removed by the caller after commit, and the moved ones
+    //  are moved back if the transaction is discarded. runtime_error is thrown only
+    //  before anything is changed, so the rest of the transaction can go on
+    uint64_t add_file(StorageModel::StorageFile&& file,
+                      string const& known_hash,
+                      string& uri,
+                      vector<filesystem::path>& inlined,
+                      vector<pair<filesystem::path, filesystem::path>>& moved)
+    {
+        filesystem::path path(file.data);
+
+        boost::system::error_code ec;
+        uint64_t size = filesystem::file_size(path, ec);
+        if (ec || 0 == size)
+            throw std::runtime_error(file.data + ": empty or does not exist, cannot store");
+
+        if (size < storage_inline_size_limit)
+        {
+            std::istreambuf_iterator<char> end, begin;
+            filesystem::ifstream fl;
+
+            meshpp::load_file(path, fl, begin, end);
+            if (begin == end)
+                throw std::runtime_error(file.data + ": empty or does not exist, cannot store");
+
+            file.data.assign(begin, end);
+            inlined.push_back(path);
+
+            return add_data(std::move(file), uri);
+        }
+
+        //  hashed in blocks, the large files are never loaded into memory
+        if (known_hash.empty())
+            uri = hash_file(path, size);
+        else
+            uri = known_hash;
+
+        if (map.contains(uri))
+            return add(uri, file);
+
+        filesystem::path new_location = path_binaries / uri;
+
+        filesystem::rename(path, new_location, ec);
+        if (ec)
+            throw std::runtime_error(file.data + ": " + ec.message() + ", cannot store");
+        moved.push_back(std::make_pair(path, new_location));
+
+        file.data = ":PATH_URI:";
+        file.duplicate_count = 1;
+
+        return add(uri, file);
+    }
+
+    void discard(vector<pair<filesystem::path, filesystem::path>> const& moved)
+    {
+        map.discard();
+
+        boost::system::error_code ec;
+        for (auto it = moved.rbegin(); it != moved.rend(); ++it)
+            filesystem::rename(it->second, it->first, ec);
+    }
+
+    void commit(vector<filesystem::path> const& inlined)
+    {
+        map.commit();
+
+        boost::system::error_code ec;
+        for (auto const& path : inlined)
+        {
+            if (false == filesystem::remove(path, ec) || ec)
+                throw std::logic_error("storage::put_file: filesystem::remove(path, ec)");
+        }
+    }
+
+    //  returns the count before removal, 0 if the uri is not there
+    uint64_t remove(string const& uri, vector<filesystem::path>& removed)
+    {
+        if (false == map.contains(uri))
+            return 0;
+
+        auto& file = map.at(uri);
+
+        uint64_t result = file.duplicate_count;
+        assert(result >= 1);
+
+        if (result == 1)
+        {
+            map.erase(uri);
+            removed.push_back(path_binaries / uri);
+        }
+        else
+            --file.duplicate_count;
+
+        return result;
+    }
+
     meshpp::map_loader<StorageModel::StorageFile> map;
     filesystem::path path_binaries;
 };
+
+metrics::histogram const get_duration("cloudy_storage_get_seconds",
+                                      "storage file read time");
+metrics::histogram const put_duration("cloudy_storage_put_seconds",
+                                      "storage transaction time of the file additions");
+metrics::histogram const remove_duration("cloudy_storage_remove_seconds",
+                                         "storage transaction time of the file removals");
 }
 
 storage::storage(filesystem::path const& path,
@@ -42,26 +175,14 @@ storage::~storage()
 
 uint64_t storage::put(StorageModel::StorageFile&& file, string& uri)
 {
-    uint64_t result;
+    metrics::timer timer(detail::put_duration);
 
-    uri = meshpp::hash(file.data);
-    file.data = meshpp::to_base64(file.data, true);
-    file.duplicate_count = 1;
     beltpp::on_failure guard([this]
     {
         m_pimpl->map.discard();
     });
 
-    if (m_pimpl->map.contains(uri))
-    {
-        auto& duplicate_count = m_pimpl->map.at(uri).duplicate_count;
-        ++duplicate_count;
-        result = duplicate_count;
-    }
-    else if (m_pimpl->map.insert(uri, file))
-        result = 1;
-    else
-        throw std::logic_error("storage::put: false == m_pimpl->map.insert(uri, file)");
+    uint64_t result = m_pimpl->add_data(std::move(file), uri);
 
     m_pimpl->map.save();
 
@@ -71,74 +192,83 @@ uint64_t storage::put(StorageModel::StorageFile&& file, string& uri)
     return result;
 }
 
-uint64_t storage::put_file(StorageModel::StorageFile&& file, string& uri)
+uint64_t storage::put_file(StorageModel::StorageFile&& file, string const& known_hash, string& uri)
 {
-    uint64_t result;
-
-    std::istreambuf_iterator<char> end, begin;
-    filesystem::ifstream fl;
-    filesystem::path path(file.data);
+    vector<StorageModel::StorageFile> files;
+    files.push_back(std::move(file));
+    vector<string> uris;
+    vector<string> errors;
 
-    meshpp::load_file(path, fl, begin, end);
-    if (begin == end)
-        throw std::runtime_error(file.data + ": empty or does not exist, cannot store");
+    uint64_t result = put_files(std::move(files), vector<string>(1, known_hash), uris, errors).front();
+    if (0 == result)
+        throw std::runtime_error(errors.front());
 
-    string file_contents(begin, end);
+    uri = uris.front();
+    return result;
+}
 
-    if (file_contents.size() < 10 * 1024 * 1024)
-    {
-        file.data = std::move(file_contents);
-        result = put(std::move(file), uri);
+vector<uint64_t> storage::put_files(vector<StorageModel::StorageFile>&& files,
+                                    vector<string> const& known_hashes,
+                                    vector<string>& uris,
+                                    vector<string>& errors)
+{
+    if (files.size() != known_hashes.size())
+        throw std::logic_error("storage::put_files: files.size() != known_hashes.size()");
 
-        boost::system::error_code ec;
-        if (false == filesystem::remove(path, ec) || ec)
-            throw std::logic_error("storage::put_file: filesystem::remove(path, ec)");
+    metrics::timer timer(detail::put_duration);
 
-        return result;
-    }
+    vector<uint64_t> result;
+    result.reserve(files.size());
+    uris.clear();
+    uris.reserve(files.size());
+    errors.clear();
+    errors.reserve(files.size());
 
-    uri = meshpp::hash(file_contents);
+    vector<filesystem::path> inlined;
+    vector<pair<filesystem::path, filesystem::path>> moved;
 
-    beltpp::on_failure guard([this]
+    beltpp::on_failure guard([this, &moved]
     {
-        m_pimpl->map.discard();
+        m_pimpl->discard(moved);
     });
 
-    if (m_pimpl->map.contains(uri))
-    {
-        auto& duplicate_count = m_pimpl->map.at(uri).duplicate_count;
-        ++duplicate_count;
-        result = duplicate_count;
-    }
-    else
+    for (size_t index = 0; index != files.size(); ++index)
     {
-        result = 1;
-
-        filesystem::path new_location = m_pimpl->path_binaries / uri;
-
-        boost::system::error_code ec;
-        filesystem::rename(path, new_location, ec);
-        if (ec)
-            throw std::logic_error("storage::put_file: filesystem::rename(path, new_location, ec)");
-
-        file.data = ":PATH_URI:";
-        file.duplicate_count = 1;
-
-        if (false == m_pimpl->map.insert(uri, file))
-            throw std::logic_error("storage::put_file: false == m_pimpl->map.insert(uri, file)");
-
+        string uri;
+        string error;
+        uint64_t count = 0;
+        try
+        {
+            count = m_pimpl->add_file(std::move(files[index]),
+                                      known_hashes[index],
+                                      uri,
+                                      inlined,
+                                      moved);
+        }
+        catch (std::runtime_error const& ex)
+        {
+            //  this file is left out, the others are still stored
+            uri.clear();
+            error = ex.what();
+        }
+
+        result.push_back(count);
+        uris.push_back(std::move(uri));
+        errors.push_back(std::move(error));
     }
 
     m_pimpl->map.save();
 
     guard.dismiss();
-    m_pimpl->map.commit();
+    m_pimpl->commit(inlined);
 
     return result;
 }
 
 bool storage::get(string const& uri, StorageModel::StorageFile& file)
 {
+    metrics::timer timer(detail::get_duration);
+
     if (false == m_pimpl->map.contains(uri))
         return false;
 
@@ -169,31 +299,40 @@ bool storage::get(string const& uri, StorageModel::StorageFile& file)
 
 uint64_t storage::remove(string const& uri)
 {
-    if (false == m_pimpl->map.contains(uri))
-        return 0;
+    return remove_batch(vector<string>(1, uri)).front();
+}
+
+vector<uint64_t> storage::remove_batch(vector<string> const& uris)
+{
+    metrics::timer timer(detail::remove_duration);
 
-    auto& file = m_pimpl->map.at(uri);
+    vector<uint64_t> result;
+    result.reserve(uris.size());
+    vector<filesystem::path> removed;
 
     beltpp::on_failure guard([this]
     {
         m_pimpl->map.discard();
     });
 
-    uint64_t result = file.duplicate_count;
-    assert(result >= 1);
+    bool changed = false;
+    for (auto const& uri : uris)
+    {
+        result.push_back(m_pimpl->remove(uri, removed));
+        if (result.back())
+            changed = true;
+    }
+
+    if (false == changed)
+    {
+        guard.dismiss();
+        return result;
+    }
 
-    if (result == 1)
-        m_pimpl->map.erase(uri);
-    else
-        --file.duplicate_count;
-    
     m_pimpl->map.save();
 
-    if (result == 1)
-    {
-        filesystem::path path(m_pimpl->path_binaries / uri);
+    for (auto const& path : removed)
         filesystem::remove(path);
-    }
 
     guard.dismiss();
     m_pimpl->map.commit();
@@ -7,6 +7,7 @@
 
 #include <memory>
 #include <unordered_set>
+#include <vector>
 
 namespace cloudy
 {
@@ -16,7 +17,7 @@ namespace detail
 class storage_internals;
 }
 
-class storage
+class CLOUDYSERVERSHARED_EXPORT storage
 {
 public:
     storage(boost::filesystem::path const& path,
@@ -24,9 +25,18 @@ public:
     ~storage();
 
     uint64_t put(StorageModel::StorageFile&& file, std::string& uri);
-    uint64_t put_file(StorageModel::StorageFile&& file, std::string& uri);
+    //  known_hash is used instead of reading the file to hash it, when not empty
+    uint64_t put_file(StorageModel::StorageFile&& file, std::string const& known_hash, std::string& uri);
+    //  the files are stored in a single transaction. 0 in place of the files that
+    //  can't be stored, with the reason in errors, the rest are stored anyway
+    std::vector<uint64_t> put_files(std::vector<StorageModel::StorageFile>&& files,
+                                    std::vector<std::string> const& known_hashes,
+                                    std::vector<std::string>& uris,
+                                    std::vector<std::string>& errors);
     bool get(std::string const& uri, StorageModel::StorageFile& file);
     uint64_t remove(std::string const& uri);
+    //  0 in place of the uris that are not there
+    std::vector<uint64_t> remove_batch(std::vector<std::string> const& uris);
     std::unordered_set<std::string> get_file_uris() const;
 private:
     std::unique_ptr<detail::storage_internals> m_pimpl;
@@ -2,6 +2,7 @@
 
 #include "storage_model.hpp"
 #include "common.hpp"
+#include "metrics.hpp"
 
 #include <belt.pp/parser.hpp>
 #include <belt.pp/http.hpp>
@@ -259,6 +260,28 @@ beltpp::detail::pmsg_all message_list_load(
 
             return protocol_error();
         }
+        else if (ss.type == beltpp::http::detail::scan_status::get &&
+                 ss.resource.path.size() == 1 &&
+                 ss.resource.path.front() == "metrics")
+        {
+            ssd.session_specal_handler = nullptr;
+
+            string metrics_buffer = metrics::scrape();
+
+            string metrics_result;
+            metrics_result += "HTTP/1.1 200 OK\r\n";
+            metrics_result += "Content-Type: text/plain; version=0.0.4\r\n";
+            metrics_result += "Content-Length: ";
+            metrics_result += std::to_string(metrics_buffer.size());
+            metrics_result += "\r\n\r\n";
+            metrics_result += metrics_buffer;
+
+            ssd.autoreply = metrics_result;
+
+            return ::beltpp::detail::pmsg_all(size_t(-1),
+                                              ::beltpp::void_unique_nullptr(),
+                                              nullptr);
+        }
         else if (ss.type == beltpp::http::detail::scan_status::get &&
                  ss.resource.path.size() == 1 &&
                  ss.resource.path.front() == "protocol")
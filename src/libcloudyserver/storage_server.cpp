@@ -5,6 +5,7 @@
 #include "storage_model.hpp"
 #include "internal_model.hpp"
 #include "storage_http.hpp"
+#include "metrics.hpp"
 
 #include <belt.pp/socket.hpp>
 
@@ -61,6 +62,11 @@ public:
     meshpp::public_key pb_key;
     wait_result wait_result_info;
 
+    metrics::route route_file;
+    metrics::route route_file_range;
+    metrics::route route_file_details;
+    metrics::counter bytes_served;
+
     storage_server_internals(beltpp::ip_address const& bind_to_address,
                              filesystem::path const& path,
                              filesystem::path const& path_binaries,
@@ -73,6 +79,10 @@ public:
         , ptr_direct_stream(beltpp::construct_direct_stream(storage_peerid, *ptr_eh, channel))
         , m_storage(path, path_binaries)
         , pb_key(_pb_key)
+        , route_file("storage", "file")
+        , route_file_range("storage", "file_range")
+        , route_file_details("storage", "file_details")
+        , bytes_served("cloudy_storage_served_bytes_total", "file bytes sent to the http clients")
     {
         ptr_eh->set_timer(event_timer_period);
 
@@ -140,6 +150,9 @@ void storage_server::run(bool& stop)
 
         beltpp::stream* psk = m_pimpl->ptr_socket.get();
 
+        auto started = chrono::steady_clock::now();
+        metrics::route const* proute = nullptr;
+
         try
         {
             switch (received_packet.type())
@@ -167,6 +180,7 @@ void storage_server::run(bool& stop)
             case beltpp::socket_open_error::rtt: break;
             case StorageFileRequest::rtt:
             {
+                proute = &m_pimpl->route_file;
                 StorageFileRequest file_info;
                 std::move(received_packet).get(file_info);
 
@@ -197,6 +211,7 @@ void storage_server::run(bool& stop)
                 if (false == file_uri.empty() &&
                     m_pimpl->m_storage.get(file_uri, file))
                 {
+                    m_pimpl->bytes_served.add(file.data.size());
                     psk->send(peerid, beltpp::packet(std::move(file)));
                 }
                 else
@@ -211,6 +226,7 @@ void storage_server::run(bool& stop)
             }
             case StorageFileRangeRequest::rtt:
             {
+                proute = &m_pimpl->route_file_range;
                 StorageFileRangeRequest file_info;
                 std::move(received_packet).get(file_info);
 
@@ -254,6 +270,7 @@ void storage_server::run(bool& stop)
                     fr.data = file.data.substr(fr.start, fr.count);
                     fr.mime_type = file.mime_type;
 
+                    m_pimpl->bytes_served.add(fr.data.size());
                     psk->send(peerid, beltpp::packet(std::move(fr)));
                 }
                 else
@@ -268,6 +285,7 @@ void storage_server::run(bool& stop)
             }
             case StorageFileDetails::rtt:
             {
+                proute = &m_pimpl->route_file_details;
                 StorageFileDetails details_request;
                 std::move(received_packet).get(details_request);
 
@@ -300,6 +318,9 @@ void storage_server::run(bool& stop)
                 break;
             }
             }   // switch ref_packet.type()
+
+            if (proute)
+                proute->observe(chrono::steady_clock::now() - started);
         }
         catch (std::exception const& e)
         {
@@ -358,7 +379,9 @@ void storage_server::run(bool& stop)
                 storage_file.data = storage_file_add.file;
 
                 string uri;
-                uint64_t duplicate_count = m_pimpl->m_storage.put_file(std::move(storage_file), uri);
+                uint64_t duplicate_count = m_pimpl->m_storage.put_file(std::move(storage_file),
+                                                                       storage_file_add.hash ? *storage_file_add.hash : string(),
+                                                                       uri);
                 assert(duplicate_count);
                 
                 StorageFileAddress file_address;
@@ -392,6 +415,78 @@ void storage_server::run(bool& stop)
                 }
                 break;
             }
+            case StorageFileAddBatch::rtt:
+            {
+                StorageFileAddBatch storage_file_add_batch;
+                std::move(received_packet).get(storage_file_add_batch);
+
+                vector<StorageFile> storage_files;
+                vector<string> known_hashes;
+                storage_files.reserve(storage_file_add_batch.files.size());
+                known_hashes.reserve(storage_file_add_batch.files.size());
+
+                for (auto& storage_file_add : storage_file_add_batch.files)
+                {
+                    StorageFile storage_file;
+                    storage_file.mime_type = std::move(storage_file_add.mime_type);
+                    storage_file.data = std::move(storage_file_add.file);
+
+                    storage_files.push_back(std::move(storage_file));
+                    known_hashes.push_back(storage_file_add.hash ? *storage_file_add.hash : string());
+                }
+
+                vector<string> uris;
+                vector<string> errors;
+                auto duplicate_counts = m_pimpl->m_storage.put_files(std::move(storage_files),
+                                                                     known_hashes,
+                                                                     uris,
+                                                                     errors);
+
+                StorageFileAddressBatch file_address_batch;
+                file_address_batch.addresses.reserve(uris.size());
+                for (size_t index = 0; index != uris.size(); ++index)
+                {
+                    assert(duplicate_counts[index] || false == errors[index].empty());
+
+                    StorageFileAddress file_address;
+                    file_address.uri = std::move(uris[index]);
+                    file_address.duplicate_count = duplicate_counts[index];
+
+                    file_address_batch.addresses.push_back(std::move(file_address));
+                }
+                file_address_batch.errors = std::move(errors);
+
+                stream.send(peerid, packet(std::move(file_address_batch)));
+
+                break;
+            }
+            case StorageFileDeleteBatch::rtt:
+            {
+                StorageFileDeleteBatch storage_file_delete_batch;
+                std::move(received_packet).get(storage_file_delete_batch);
+
+                auto existing_counts = m_pimpl->m_storage.remove_batch(storage_file_delete_batch.uris);
+
+                StorageFileDeletedBatch file_deleted_batch;
+                for (size_t index = 0; index != existing_counts.size(); ++index)
+                {
+                    auto& uri = storage_file_delete_batch.uris[index];
+
+                    if (existing_counts[index])
+                    {
+                        StorageFileDeleted file_deleted;
+                        file_deleted.uri = std::move(uri);
+                        file_deleted.remaining_count = existing_counts[index] - 1;
+                        file_deleted_batch.deleted.push_back(std::move(file_deleted));
+                    }
+                    else
+                        file_deleted_batch.missing.push_back(std::move(uri));
+                }
+
+                stream.send(peerid, packet(std::move(file_deleted_batch)));
+
+                break;
+            }
             case FileUrisRequest::rtt:
             {
                 FileUris msg;
@@ -0,0 +1,218 @@
+#include "tracing.hpp"
+#include "common.hpp"
+
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdio>
+
+namespace chrono = std::chrono;
+using std::string;
+using std::vector;
+using std::list;
+using std::unordered_map;
+
+namespace cloudy
+{
+namespace trace
+{
+namespace detail
+{
+class event
+{
+public:
+    //  as in chrome trace event format, B - stage begin, E - stage end, i - instant
+    char phase;
+    char const* name;
+    int64_t timestamp;
+    string description;
+};
+
+class item_trace
+{
+public:
+    uint64_t id;
+    string item;
+    char const* current_stage;
+    bool finished;
+    vector<event> events;
+
+    void add(char phase, char const* name, int64_t timestamp, string const& description)
+    {
+        //  the stages are recorded even above the limit, to keep them paired
+        if (phase == 'i' && events.size() >= trace_event_limit)
+            return;
+
+        event value;
+        value.phase = phase;
+        value.name = name;
+        value.timestamp = timestamp;
+        value.description = description;
+
+        events.push_back(std::move(value));
+    }
+
+    void end_stage(int64_t timestamp)
+    {
+        if (current_stage)
+            add('E', current_stage, timestamp, string());
+        current_stage = nullptr;
+    }
+};
+
+class tracer
+{
+public:
+    std::mutex mutex;
+    list<item_trace> items;
+    unordered_map<string, list<item_trace>::iterator> index;
+    uint64_t next_id = 1;
+
+    //  called with the mutex locked
+    item_trace& find(string const& item)
+    {
+        auto it = index.find(item);
+        if (it != index.end() &&
+            false == it->second->finished)
+            return *it->second;
+
+        item_trace trace;
+        trace.id = next_id++;
+        trace.item = item;
+        trace.current_stage = nullptr;
+        trace.finished = false;
+
+        items.push_back(std::move(trace));
+        index[item] = std::prev(items.end());
+
+        while (items.size() > trace_item_limit)
+        {
+            auto it_index = index.find(items.front().item);
+            if (it_index != index.end() &&
+                it_index->second == items.begin())
+                index.erase(it_index);
+            items.pop_front();
+        }
+
+        return items.back();
+    }
+};
+
+tracer& get_tracer()
+{
+    //  never destroyed, the threads may still record at exit
+    static tracer* pinstance = new tracer();
+    return *pinstance;
+}
+
+int64_t now()
+{
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+string json_string(string const& value)
+{
+    string result = "\"";
+    for (char ch : value)
+    {
+        if (ch == '"' || ch == '\\')
+        {
+            result += '\\';
+            result += ch;
+        }
+        else if (static_cast<unsigned char>(ch) < 0x20)
+        {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", int(ch));
+            result += buffer;
+        }
+        else
+            result += ch;
+    }
+    result += "\"";
+
+    return result;
+}
+}
+
+void stage(string const& item, char const* name)
+{
+    int64_t timestamp = detail::now();
+
+    auto& instance = detail::get_tracer();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+
+    auto& trace = instance.find(item);
+    trace.end_stage(timestamp);
+    trace.add('B', name, timestamp, string());
+    trace.current_stage = name;
+}
+
+void instant(string const& item, char const* name, string const& description)
+{
+    int64_t timestamp = detail::now();
+
+    auto& instance = detail::get_tracer();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+
+    instance.find(item).add('i', name, timestamp, description);
+}
+
+void finish(string const& item, char const* name, string const& description)
+{
+    int64_t timestamp = detail::now();
+
+    auto& instance = detail::get_tracer();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+
+    auto& trace = instance.find(item);
+    trace.end_stage(timestamp);
+    trace.add('i', name, timestamp, description);
+    trace.finished = true;
+}
+
+string chrome_json(string const& item)
+{
+    auto& instance = detail::get_tracer();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+
+    string result = "{\"traceEvents\":[";
+    bool first = true;
+
+    for (auto const& trace : instance.items)
+    {
+        if (false == item.empty() && trace.item != item)
+            continue;
+
+        string tid = std::to_string(trace.id);
+
+        if (false == first)
+            result += ",";
+        first = false;
+
+        result += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid +
+                  ",\"args\":{\"name\":" + detail::json_string(trace.item) + "}}";
+
+        for (auto const& event : trace.events)
+        {
+            result += ",{\"name\":" + detail::json_string(event.name) +
+                      ",\"ph\":\"" + string(1, event.phase) + "\"" +
+                      ",\"ts\":" + std::to_string(event.timestamp) +
+                      ",\"pid\":1,\"tid\":" + tid;
+            if (event.phase == 'i')
+                result += ",\"s\":\"t\"";
+            if (false == event.description.empty())
+                result += ",\"args\":{\"description\":" + detail::json_string(event.description) + "}";
+            result += "}";
+        }
+    }
+
+    result += "],\"displayTimeUnit\":\"ms\"}";
+
+    return result;
+}
+}
+}
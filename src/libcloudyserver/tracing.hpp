@@ -0,0 +1,23 @@
+#pragma once
+
+#include "global.hpp"
+
+#include <string>
+
+namespace cloudy
+{
+namespace trace
+{
+//  the lifecycle of the media items, by path, with the steady clock timestamps.
+//  an item is in a single stage at a time, the next stage ends the previous one.
+//  only the latest trace_item_limit items are kept
+void stage(std::string const& item, char const* name);
+void instant(std::string const& item, char const* name, std::string const& description = std::string());
+//  ends the current stage, the next stage of the item starts a new trace
+void finish(std::string const& item, char const* name, std::string const& description = std::string());
+
+//  in chrome trace event format, every item on a track of its own.
+//  all the items if item is empty
+std::string chrome_json(std::string const& item = std::string());
+}
+}
@@ -0,0 +1,250 @@
+#include "watcher.hpp"
+#include "common.hpp"
+
+#include <boost/filesystem.hpp>
+
+#include <unordered_map>
+#include <utility>
+#include <exception>
+#include <ctime>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace filesystem = boost::filesystem;
+namespace chrono = std::chrono;
+using chrono::steady_clock;
+using std::string;
+using std::vector;
+using std::pair;
+using std::unordered_map;
+
+namespace cloudy
+{
+
+namespace detail
+{
+class watcher_internals
+{
+public:
+    int fd = -1;
+    //  watch descriptor to the watched directory
+    unordered_map<int, vector<string>> directories;
+    //  files waiting for the writes to settle down
+    unordered_map<string, pair<vector<string>, steady_clock::time_point>> settling;
+    vector<vector<string>> roots;
+    //  the events before this are all read, see rescan
+    std::time_t read_until = 0;
+
+#ifdef __linux__
+    watcher_internals()
+        : fd(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+    {
+        if (fd < 0)
+            throw std::runtime_error(string("inotify_init1: ") + std::strerror(errno));
+    }
+    ~watcher_internals()
+    {
+        ::close(fd);
+    }
+
+    void settle(vector<string> const& path, bool only_if_settling)
+    {
+        string path_string = join_path(path).first;
+
+        auto it = settling.find(path_string);
+        if (it != settling.end())
+            it->second.second = steady_clock::now();
+        else if (false == only_if_settling)
+            settling.insert(std::make_pair(path_string, std::make_pair(path, steady_clock::now())));
+    }
+
+    //  only the failure on a root is an error, the subdirectories that can't be watched
+    //  (no access, or max_user_watches reached) are skipped along with what is inside.
+    //  with changed_since only the files written or moved in after it are settled
+    void add_directory(vector<string> const& path,
+                       bool settle_files,
+                       bool root,
+                       std::time_t changed_since = 0)
+    {
+        auto fs_path = check_path(path).first;
+
+        int wd = ::inotify_add_watch(fd,
+                                     fs_path.string().c_str(),
+                                     IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_CREATE | IN_ONLYDIR);
+        if (wd < 0)
+        {
+            if (root)
+                throw std::runtime_error("inotify_add_watch: " + fs_path.string() + ", " + std::strerror(errno));
+            return;
+        }
+
+        directories[wd] = path;
+
+        boost::system::error_code ec;
+        filesystem::directory_iterator it_end;
+        filesystem::directory_iterator it(fs_path, ec);
+
+        for (; !ec && it != it_end; it.increment(ec))
+        {
+            string name = it->path().filename().string();
+            if (name.empty() || name.front() == '.')
+                continue;
+
+            auto child_path = path;
+            child_path.push_back(name);
+
+            //  an entry that can't be checked does not end the scan of the others
+            boost::system::error_code ec_entry;
+            if (filesystem::is_directory(it->path(), ec_entry))
+                add_directory(child_path, settle_files, false, changed_since);
+            else if (settle_files &&
+                     filesystem::is_regular_file(it->path(), ec_entry) &&
+                     changed(it->path(), changed_since))
+                settle(child_path, false);
+        }
+    }
+
+    //  a move keeps the modification time, but updates the change time
+    static bool changed(filesystem::path const& path, std::time_t since)
+    {
+        if (0 == since)
+            return true;
+
+        struct stat st;
+        if (0 != ::stat(path.string().c_str(), &st))
+            return false;
+
+        return st.st_mtime >= since || st.st_ctime >= since;
+    }
+
+    //  the kernel queue overflowed and the events got lost, so the roots are scanned
+    //  again, the watches of the new directories are added along the way
+    void rescan()
+    {
+        //  the timestamps have a second resolution on some filesystems
+        std::time_t changed_since = read_until - 1;
+
+        for (auto const& root : roots)
+            add_directory(root, true, false, changed_since);
+    }
+#endif
+};
+}
+
+watcher::watcher()
+    : m_pimpl(new detail::watcher_internals())
+{}
+watcher::~watcher()
+{}
+
+#ifdef __linux__
+void watcher::reset(vector<vector<string>> const& roots)
+{
+    for (auto const& item : m_pimpl->directories)
+        ::inotify_rm_watch(m_pimpl->fd, item.first);
+    m_pimpl->directories.clear();
+    m_pimpl->settling.clear();
+    m_pimpl->roots = roots;
+    m_pimpl->read_until = std::time(nullptr);
+
+    for (auto const& root : roots)
+        m_pimpl->add_directory(root, false, true);
+}
+
+vector<vector<string>> watcher::poll(steady_clock::duration const& settle_period)
+{
+    alignas(struct inotify_event) char buffer[64 * 1024];
+
+    std::time_t read_from = std::time(nullptr);
+    bool overflow = false;
+
+    while (true)
+    {
+        ssize_t length = ::read(m_pimpl->fd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+
+        for (char* ptr = buffer; ptr < buffer + length; )
+        {
+            auto const* event = reinterpret_cast<struct inotify_event const*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                overflow = true;
+                continue;
+            }
+
+            if (event->mask & IN_IGNORED)
+            {
+                m_pimpl->directories.erase(event->wd);
+                continue;
+            }
+
+            auto it = m_pimpl->directories.find(event->wd);
+            if (it == m_pimpl->directories.end() ||
+                0 == event->len)
+                continue;
+
+            string name(event->name);
+            //  skip hidden and temporary files, the uploaders usually rename them when done
+            if (name.empty() || name.front() == '.')
+                continue;
+
+            auto path = it->second;
+            path.push_back(name);
+
+            if (event->mask & IN_ISDIR)
+            {
+                //  a new directory can already have files in it, by the time the watch is added
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    m_pimpl->add_directory(path, true, false);
+            }
+            else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                m_pimpl->settle(path, false);
+            else if (event->mask & IN_MODIFY)
+                m_pimpl->settle(path, true);
+        }
+    }
+
+    if (overflow)
+        m_pimpl->rescan();
+    m_pimpl->read_until = read_from;
+
+    vector<vector<string>> result;
+    auto now = steady_clock::now();
+
+    auto it = m_pimpl->settling.begin();
+    while (it != m_pimpl->settling.end())
+    {
+        if (now - it->second.second >= settle_period)
+        {
+            result.push_back(std::move(it->second.first));
+            it = m_pimpl->settling.erase(it);
+        }
+        else
+            ++it;
+    }
+
+    return result;
+}
+#else
+void watcher::reset(vector<vector<string>> const& roots)
+{
+    if (false == roots.empty())
+        throw std::runtime_error("watcher::reset: directory watch is not supported on this platform");
+}
+
+vector<vector<string>> watcher::poll(steady_clock::duration const&)
+{
+    return vector<vector<string>>();
+}
+#endif
+
+}
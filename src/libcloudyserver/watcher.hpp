@@ -0,0 +1,31 @@
+#pragma once
+
+#include "global.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+
+namespace cloudy
+{
+
+namespace detail
+{
+class watcher_internals;
+}
+
+class watcher
+{
+public:
+    watcher();
+    ~watcher();
+
+    void reset(std::vector<std::vector<std::string>> const& roots);
+    //  returns the files that had no write activity during settle_period
+    std::vector<std::vector<std::string>> poll(std::chrono::steady_clock::duration const& settle_period);
+private:
+    std::unique_ptr<detail::watcher_internals> m_pimpl;
+};
+
+}
@@ -5,9 +5,13 @@
 #include "admin_model.hpp"
 
 #include "libavwrapper.hpp"
+#include "metrics.hpp"
+#include "tracing.hpp"
+#include "watcher.hpp"
 
 #include <belt.pp/packet.hpp>
 #include <belt.pp/processor.hpp>
+#include <belt.pp/scope_helper.hpp>
 
 #include <mesh.pp/fileutility.hpp>
 #include <mesh.pp/cryptoutility.hpp>
@@ -15,12 +19,28 @@
 #include <boost/filesystem.hpp>
 
 #include <memory>
+#include <algorithm>
+#include <iterator>
+#include <deque>
+#include <future>
 #include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <unordered_set>
 #include <unordered_map>
 #include <utility>
 #include <exception>
 
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 using namespace InternalModel;
 
 using beltpp::packet;
@@ -46,8 +66,339 @@ namespace cloudy
 namespace detail
 {
 
+#ifdef __linux__
+//  shares the data blocks of the source on the filesystems that support it
+bool reflink_file(filesystem::path const& from, filesystem::path const& to)
+{
+#ifdef FICLONE
+    int fd_from = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_from < 0)
+        return false;
+
+    int fd_to = ::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd_to < 0)
+    {
+        ::close(fd_from);
+        return false;
+    }
+
+    bool done = (0 == ::ioctl(fd_to, FICLONE, fd_from));
+
+    ::close(fd_to);
+    ::close(fd_from);
+
+    if (false == done)
+    {
+        boost::system::error_code ec;
+        filesystem::remove(to, ec);
+    }
+
+    return done;
+#else
+    B_UNUSED(from);
+    B_UNUSED(to);
+    return false;
+#endif
+}
+
+//  the data does not pass through the user space, and the kernel may offload it further
+bool copy_range_file(filesystem::path const& from, filesystem::path const& to)
+{
+#ifdef __NR_copy_file_range
+    int fd_from = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_from < 0)
+        return false;
+
+    int fd_to = ::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd_to < 0)
+    {
+        ::close(fd_from);
+        return false;
+    }
+
+    bool done = false;
+    struct stat info;
+    if (0 == ::fstat(fd_from, &info))
+    {
+        off_t left = info.st_size;
+        while (left > 0)
+        {
+            ssize_t copied = ::syscall(__NR_copy_file_range,
+                                       fd_from, nullptr,
+                                       fd_to, nullptr,
+                                       size_t(left), 0u);
+            if (copied <= 0)
+                break;
+            left -= off_t(copied);
+        }
+        done = (0 == left);
+    }
+
+    ::close(fd_to);
+    ::close(fd_from);
+
+    if (false == done)
+    {
+        boost::system::error_code ec;
+        filesystem::remove(to, ec);
+    }
+
+    return done;
+#else
+    B_UNUSED(from);
+    B_UNUSED(to);
+    return false;
+#endif
+}
+#endif
+
+//  the raw copies are as large as the originals, so copying the bytes is the last resort.
+//  a hard link shares the inode with the original, so it's tried only after the reflink
+void copy_raw(filesystem::path const& from, filesystem::path const& to)
+{
+#ifdef __linux__
+    if (reflink_file(from, to))
+        return;
+#endif
+
+    boost::system::error_code ec;
+    filesystem::create_hard_link(from, to, ec);
+    if (!ec)
+        return;
+
+#ifdef __linux__
+    if (copy_range_file(from, to))
+        return;
+#endif
+
+    filesystem::ifstream source(from, std::ios_base::binary);
+    filesystem::ofstream destination(to, std::ios_base::binary | std::ios_base::trunc);
+    if (source && destination)
+        std::copy(std::istreambuf_iterator<char>(source),
+                  std::istreambuf_iterator<char>(),
+                  std::ostreambuf_iterator<char>(destination));
+    if (false == bool(source) ||
+        false == bool(destination.flush()))
+        throw std::runtime_error("copy_raw: cannot copy " +
+                                 from.string() + " to " +
+                                 to.string());
+}
+
+//  counts the results sent to admin and not stored yet, see StorageCredit. the media check
+//  waits for the count to go below the limit before it starts transcoding the next part,
+//  so that the worker directory does not grow while the storage falls behind
+class storage_gate
+{
+public:
+    explicit storage_gate(uint64_t _limit)
+        : limit(_limit)
+        , in_flight(0)
+        , closed(false)
+    {}
+
+    void sent(uint64_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        in_flight += count;
+    }
+
+    void acknowledged(uint64_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        in_flight -= std::min(count, in_flight);
+        condition.notify_all();
+    }
+
+    //  gives up after a while, in case a credit got lost on the way
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait_for(lock, storage_gate_timeout, [this]
+        {
+            return closed || 0 == limit || in_flight < limit;
+        });
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        condition.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    uint64_t limit;
+    uint64_t in_flight;
+    bool closed;
+};
+
+//  processor_worker is given to the processor as a plain function,
+//  this is how it finds the gate of the worker
+std::atomic<storage_gate*> pstorage_gate(nullptr);
+
+metrics::gauge const busy_threads("cloudy_worker_busy_threads",
+                                  "worker threads processing an index or a media check");
+metrics::counter const transcoded_frames("cloudy_transcode_frames_total",
+                                         "video frames decoded for transcode");
+metrics::gauge const transcode_fps("cloudy_transcode_fps",
+                                   "video frames per second of the last transcoded part");
+metrics::counter const shared_audio("cloudy_transcode_shared_audio_total",
+                                    "profiles that took the audio encoded for another profile");
+metrics::counter const shared_audio_saved("cloudy_transcode_shared_audio_saved_milliseconds_total",
+                                          "audio encode time saved by sharing the encoder among the profiles");
+
+class transcoded_part
+{
+public:
+    pair<uint64_t, uint64_t> bounds;
+    vector<pair<AdminModel::MediaTypeDescriptionVariant, size_t>> options;
+    vector<unordered_map<size_t, work_unit>> progress;
+    uint64_t frames = 0;
+    unordered_map<size_t, uint64_t> encoded_frames;
+    chrono::steady_clock::duration elapsed = chrono::steady_clock::duration::zero();
+    libavwrapper::transcode_timings timings;
+};
+
+using TranscodeStatusVariant = AdminModel::variant_type<AdminModel::TranscodeStatus::rtt>;
+
+//  the parts done and the parts being transcoded, the transcoding threads update it
+class transcode_tracker
+{
+public:
+    transcode_tracker(vector<string> const& _path,
+                      vector<AdminModel::MediaTypeDescriptionVariant> const& _options,
+                      uint64_t _source_duration,
+                      uint64_t _resumed)
+        : path(_path)
+        , options(_options)
+        , source_duration(_source_duration)
+        , resumed(_resumed)
+        , done_positions(_options.size(), 0)
+        , done_encoded_frames(_options.size(), 0)
+        , started(chrono::steady_clock::now())
+        , advanced(started)
+    {}
+
+    void update(size_t part, libavwrapper::transcode_progress const& progress)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running[part] = progress;
+    }
+
+    void part_done(size_t part, transcoded_part const& result)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running.erase(part);
+
+        done_frames += result.frames;
+        for (auto const& progress : result.progress)
+        for (auto const& progress_item : progress)
+        {
+            if (progress_item.first < done_positions.size())
+                done_positions[progress_item.first] += progress_item.second.duration;
+        }
+        for (auto const& encoded : result.encoded_frames)
+        {
+            if (encoded.first < done_encoded_frames.size())
+                done_encoded_frames[encoded.first] += encoded.second;
+        }
+    }
+
+    AdminModel::TranscodeStatus status()
+    {
+        auto now = chrono::steady_clock::now();
+
+        uint64_t frames = done_frames;
+        vector<uint64_t> positions = done_positions;
+        vector<uint64_t> encoded_frames = done_encoded_frames;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto const& part : running)
+            {
+                frames += part.second.frames;
+                for (auto const& position : part.second.positions)
+                {
+                    if (position.first < positions.size())
+                        positions[position.first] += position.second;
+                }
+                for (auto const& encoded : part.second.encoded_frames)
+                {
+                    if (encoded.first < encoded_frames.size())
+                        encoded_frames[encoded.first] += encoded.second;
+                }
+            }
+        }
+
+        //  the audio only inputs have no frames to count
+        uint64_t total = frames;
+        for (auto position : positions)
+            total += position;
+        if (total != advanced_total)
+        {
+            advanced_total = total;
+            advanced = now;
+        }
+
+        auto elapsed = uint64_t(chrono::duration_cast<chrono::milliseconds>(now - started).count());
+
+        AdminModel::TranscodeStatus result;
+        result.path = path;
+        result.elapsed = elapsed / 1000;
+        result.stalled = uint64_t(chrono::duration_cast<chrono::seconds>(now - advanced).count());
+
+        for (size_t option_index = 0; option_index != options.size(); ++option_index)
+        {
+            if (options[option_index]->type() != AdminModel::MediaTypeDescriptionAVContainer::rtt)
+                continue;
+
+            AdminModel::TranscodeProfileStatus profile;
+            profile.type_description = options[option_index];
+            profile.frames = encoded_frames[option_index];
+            profile.output_duration = resumed + positions[option_index];
+            profile.source_duration = source_duration;
+            profile.fps = 0;
+            profile.speed = 0;
+
+            if (elapsed)
+            {
+                profile.fps = double(profile.frames) * 1000 / double(elapsed);
+                //  the output milliseconds per millisecond of the wall clock
+                profile.speed = double(positions[option_index]) / double(elapsed);
+            }
+
+            if (source_duration && profile.output_duration >= source_duration)
+                profile.eta = 0;
+            else if (source_duration && profile.speed > 0)
+                profile.eta = uint64_t(double(source_duration - profile.output_duration) / profile.speed / 1000);
+
+            result.profiles.push_back(std::move(profile));
+        }
+
+        return result;
+    }
+private:
+    std::mutex mutex;
+    unordered_map<size_t, libavwrapper::transcode_progress> running;
+
+    //  only the processing thread uses the rest
+    vector<string> path;
+    vector<AdminModel::MediaTypeDescriptionVariant> options;
+    uint64_t source_duration;
+    uint64_t resumed;
+    uint64_t done_frames = 0;
+    vector<uint64_t> done_positions;
+    vector<uint64_t> done_encoded_frames;
+    chrono::steady_clock::time_point started;
+    chrono::steady_clock::time_point advanced;
+    uint64_t advanced_total = 0;
+};
+
 void processor_worker(packet&& package, beltpp::libprocessor::async_result& stream)
 {
+    metrics::scoped_increment busy(busy_threads);
+
     switch(package.type())
     {
     case InternalModel::ProcessIndexRequest::rtt:
@@ -55,6 +406,9 @@ void processor_worker(packet&& package, beltpp::libprocessor::async_result& stre
         InternalModel::ProcessIndexRequest request;
         std::move(package).get(request);
 
+        string item = join_path(request.path).first;
+        trace::stage(item, "hash");
+
         packet result;
 
         try
@@ -84,6 +438,7 @@ void processor_worker(packet&& package, beltpp::libprocessor::async_result& stre
             result.set(std::move(response));
         }
 
+        trace::stage(item, "index_result");
         stream.send(std::move(result));
 
         break;
@@ -96,6 +451,8 @@ void processor_worker(packet&& package, beltpp::libprocessor::async_result& stre
         {
             std::move(package).get(request);
 
+            trace::stage(join_path(request.path).first, "media_check");
+
             vector<AdminModel::MediaTypeDescriptionVariant> unchanged_options;
             unchanged_options.resize(request.type_descriptions.size());
             all_options.resize(request.type_descriptions.size());
@@ -112,48 +469,21 @@ void processor_worker(packet&& package, beltpp::libprocessor::async_result& stre
                 ++index;
             }
 
-            libavwrapper::transcoder transcoder;
-            transcoder.input_file = check_path(request.path).first;
-            transcoder.output_dir = request.output_dir;
-            
-            transcoder.init(all_options);
-            bool raw_done = false;
-
-            while (true)
+            //  the frames recorded in library before a restart are not transcoded again
+            vector<uint64_t> recorded(all_options.size(), 0);
+            if (request.progress)
+            for (auto const& progress_item : *request.progress)
+            for (size_t option_index = 0; option_index != unchanged_options.size(); ++option_index)
             {
-                auto progress = transcoder.run();
-
-                if (false == raw_done)
+                if (unchanged_options[option_index] == progress_item.type_description)
                 {
-                    raw_done = true;
-                    for (size_t option_index = 0; option_index != all_options.size(); ++option_index)
-                    {
-                        auto& option_item = all_options[option_index];
-
-                        if (option_item.first->type() == AdminModel::MediaTypeDescriptionRaw::rtt)
-                        {
-                            auto& progress_item = progress[option_index];
-                            InternalModel::ProcessMediaCheckResult raw_progress_item;
-
-                            auto src_location = join_path(request.path).first;
-                            filesystem::path copy_location = request.output_dir;
-                            copy_location /= std::to_string(option_index);// + "_" + std::to_string(raw_done));
-                            boost::system::error_code ec;
-                            filesystem::copy(src_location,
-                                             copy_location,
-                                             ec);
-                            if (ec)
-                                throw std::runtime_error("processor_worker: filesystem::copy(" +
-                                                         src_location + ", " +
-                                                         copy_location.string() + ")");
-
-                            progress_item.duration = 1;
-                            progress_item.data_or_file = copy_location.string();
-                            progress_item.result_type = InternalModel::ResultType::file;
-                        }
-                    }
+                    recorded[option_index] = progress_item.accumulated;
+                    all_options[option_index].second = progress_item.accumulated;
                 }
+            }
 
+            auto drop_empty = [](unordered_map<size_t, work_unit>& progress)
+            {
                 auto it = progress.begin();
                 while (it != progress.end())
                 {
@@ -163,28 +493,12 @@ void processor_worker(packet&& package, beltpp::libprocessor::async_result& stre
                     {   //  happens when processing image instead of video
                         empty_transcoder_progress = true;
                     }
-                    else if (it->second.result_type == InternalModel::ResultType::file)
-                    {
-                        filesystem::path path(it->second.data_or_file);
-                        filesystem::fstream fl;
-                        fl.open(path, std::ios_base::binary |
-                                      std::ios_base::out |
-                                      std::ios_base::in);
-
-                        if (!fl)
-                            empty_transcoder_progress = true;
-                        else
-                        {
-                            fl.seekg(0, std::ios_base::end);
-                            size_t size_when_opened = size_t(fl.tellg());
-
-                            if (0 == size_when_opened)
-                                empty_transcoder_progress = true;
-                        }
-                    }
+                    else if (it->second.result_type == InternalModel::ResultType::file &&
+                             0 == it->second.data_size)
+                        empty_transcoder_progress = true;
                     else if (it->second.data_or_file.empty())
                         empty_transcoder_progress = true;
-                    
+
                     if (empty_transcoder_progress)
                     {
                         filesystem::path path(it->second.data_or_file);
@@ -195,40 +509,435 @@ void processor_worker(packet&& package, beltpp::libprocessor::async_result& stre
                     else
                         ++it;
                 }
+            };
 
-                if (progress.empty())
+            auto collect_progress = [&request, &unchanged_options, &all_options, &recorded]
+                    (unordered_map<size_t, work_unit>& progress,
+                     vector<pair<AdminModel::MediaTypeDescriptionVariant, size_t>> const& refined_options,
+                     uint64_t part_start,
+                     vector<InternalModel::ProcessMediaCheckResult>& responses)
+            {
+                for (auto& progress_item : progress)
                 {
+                    if (part_start < recorded[progress_item.first])
+                    {
+                        if (progress_item.second.result_type == InternalModel::ResultType::file)
+                        {
+                            boost::system::error_code ec;
+                            filesystem::remove(progress_item.second.data_or_file, ec);
+                        }
+                        continue;
+                    }
+
                     InternalModel::ProcessMediaCheckResult response;
+
                     response.path = request.path;
-                    response.count = 0;
-                    response.accumulated = 0;
+                    response.result_type = progress_item.second.result_type;
+                    response.type_description = unchanged_options[progress_item.first];
+                    response.type_description_refined = refined_options[progress_item.first].first;
+                    response.accumulated = all_options[progress_item.first].second;
+                    response.count = progress_item.second.duration;
+                    response.data_or_file = progress_item.second.data_or_file;
+                    if (false == progress_item.second.data_hash.empty())
+                        response.data_hash = progress_item.second.data_hash;
+
+                    all_options[progress_item.first].second += response.count;
+
+                    responses.push_back(std::move(response));
+                }
+            };
 
-                    for (auto& option : all_options)
-                        response.accumulated += option.second;
+            auto send_progress = [&stream](vector<InternalModel::ProcessMediaCheckResult>& responses,
+                                           uint64_t resume)
+            {
+                //  the library gets the results in this order, so with the last one recorded
+                //  a restart can continue from the end of the part
+                if (resume && false == responses.empty())
+                    responses.back().resume = resume;
+
+                storage_gate* pgate = pstorage_gate.load();
+                for (auto& response : responses)
+                {
+                    if (pgate &&
+                        response.count &&
+                        false == response.data_or_file.empty())
+                        pgate->sent(1);
+
+                    if (response.count)
+                        trace::instant(join_path(response.path).first,
+                                       "segment",
+                                       std::to_string(response.count) + " ms");
 
                     stream.send(packet(std::move(response)));
-                    break;
                 }
+            };
+
+            {
+                unordered_map<size_t, work_unit> progress;
+
+                for (size_t option_index = 0; option_index != all_options.size(); ++option_index)
+                {
+                    auto& option_item = all_options[option_index];
+
+                    if (option_item.first->type() == AdminModel::MediaTypeDescriptionRaw::rtt &&
+                        0 == recorded[option_index])
+                    {
+                        auto& progress_item = progress[option_index];
+
+                        auto src_location = join_path(request.path).first;
+                        filesystem::path copy_location = request.output_dir;
+                        copy_location /= std::to_string(option_index);
+                        copy_raw(src_location, copy_location);
+
+                        boost::system::error_code ec;
+                        progress_item.duration = 1;
+                        progress_item.data_size = filesystem::file_size(copy_location, ec);
+                        if (ec)
+                            progress_item.data_size = 0;
+                        progress_item.data_or_file = copy_location.string();
+                        progress_item.result_type = InternalModel::ResultType::file;
+                    }
+                }
+
+                drop_empty(progress);
+
+                vector<InternalModel::ProcessMediaCheckResult> responses;
+                collect_progress(progress, all_options, 0, responses);
+                send_progress(responses, 0);
+            }
+
+            //  the long inputs are split on keyframes, and the parts are transcoded in parallel.
+            //  the results are still sent in order, as the frames of the media sequence
+            size_t transcode_threads = 1;
+            if (request.transcode_threads && *request.transcode_threads > 1)
+                transcode_threads = *request.transcode_threads;
+
+            //  with the segment duration set, one transcoder runs through the input, and every
+            //  profile is cut at the same timestamps, each segment starting with an idr frame.
+            //  the segments are sent as they are cut, transcode_threads does not apply
+            bool segmented = request.segment_duration && *request.segment_duration;
+
+            //  the input is opened for every part, and retried on next checks
+            filesystem::path probe_file;
+            if (request.sha256sum && false == request.sha256sum->empty())
+            {
+                probe_file = filesystem::path(request.output_dir) / "probe";
+                boost::system::error_code ec;
+                filesystem::create_directories(probe_file, ec);
+                if (ec)
+                    probe_file.clear();
                 else
+                    probe_file /= *request.sha256sum + ".json";
+            }
+
+            //  the thumbnails decode only the keyframes, so they are ready long before the transcode.
+            //  every sheet is a frame of its own media sequence
+            bool transcode = false;
+            for (size_t option_index = 0; option_index != all_options.size(); ++option_index)
+            {
+                auto& option_item = all_options[option_index];
+
+                if (option_item.first->type() == AdminModel::MediaTypeDescriptionAVContainer::rtt)
+                    transcode = true;
+                else if (option_item.first->type() == AdminModel::MediaTypeDescriptionThumbnails::rtt)
+                {
+                    AdminModel::MediaTypeDescriptionThumbnails* thumbnails_options;
+                    option_item.first->get(thumbnails_options);
+
+                    vector<work_unit> sheets;
+                    try
+                    {
+                        sheets = libavwrapper::thumbnails(check_path(request.path).first,
+                                                          probe_file,
+                                                          request.output_dir,
+                                                          option_index,
+                                                          *thumbnails_options,
+                                                          recorded[option_index]);
+                    }
+                    catch (std::exception const& e)
+                    {
+                        //  the other profiles go on
+                        InternalModel::ProcessMediaCheckWarning warning;
+                        warning.path = request.path;
+                        warning.type_description = option_item.first;
+                        warning.reason = e.what();
+
+                        stream.send(packet(std::move(warning)));
+                    }
+
+                    vector<InternalModel::ProcessMediaCheckResult> responses;
+                    for (auto& sheet : sheets)
+                    {
+                        unordered_map<size_t, work_unit> progress;
+                        progress[option_index] = std::move(sheet);
+
+                        drop_empty(progress);
+                        collect_progress(progress, all_options, recorded[option_index], responses);
+                    }
+                    send_progress(responses, 0);
+                }
+            }
+
+            vector<pair<uint64_t, uint64_t>> parts;
+            //  with no container profiles there is nothing to transcode
+            if (transcode)
+                parts = libavwrapper::split_parts(check_path(request.path).first,
+                                                  probe_file,
+                                                  transcode_threads > 1 && false == segmented ?
+                                                      transcode_part_duration : 0);
+
+            bool resume_off_bounds = false;
+            if (request.resume && *request.resume)
+            {
+                auto it = parts.begin();
+                while (it != parts.end() &&
+                       it->second != 0 &&
+                       it->second <= *request.resume)
+                    ++it;
+                parts.erase(parts.begin(), it);
+
+                //  the parts were split differently before the restart
+                if (false == parts.empty() &&
+                    parts.front().first < *request.resume)
+                {
+                    parts.front().first = *request.resume;
+                    resume_off_bounds = true;
+                }
+            }
+
+            uint64_t source_duration = 0;
+            if (false == parts.empty())
+                source_duration = libavwrapper::duration(check_path(request.path).first, probe_file);
+
+            transcode_tracker tracker(request.path,
+                                      unchanged_options,
+                                      source_duration,
+                                      parts.empty() ? 0 : parts.front().first);
+
+            auto transcode_part = [&request, &unchanged_options, &probe_file, &tracker](size_t part_index,
+                                                                           pair<uint64_t, uint64_t> part,
+                                                                           bool part_accurate,
+                                                                           string output_suffix)
+            {
+                auto started = chrono::steady_clock::now();
+
+                transcoded_part result;
+                result.bounds = part;
+                for (auto const& option : unchanged_options)
+                    result.options.push_back(std::make_pair(option, size_t(0)));
+
+                libavwrapper::transcoder transcoder;
+                transcoder.input_file = check_path(request.path).first;
+                transcoder.output_dir = request.output_dir;
+                transcoder.start = part.first;
+                transcoder.end = part.second;
+                transcoder.accurate = part_accurate;
+                transcoder.probe_file = probe_file;
+                transcoder.output_suffix = output_suffix;
+                transcoder.progress = [&tracker, part_index](libavwrapper::transcode_progress const& progress)
                 {
-                    for (auto& progress_item : progress)
+                    tracker.update(part_index, progress);
+
+                    //  the parts already running pause too, at most a progress interval late
+                    storage_gate* pgate = pstorage_gate.load();
+                    if (pgate)
+                        pgate->wait();
+                };
+
+                transcoder.init(result.options);
+
+                while (true)
+                {
+                    auto progress = transcoder.run();
+                    if (progress.empty())
+                        break;
+                    result.progress.push_back(std::move(progress));
+                }
+
+                result.frames = transcoder.frames();
+                result.encoded_frames = transcoder.encoded_frames();
+                result.elapsed = chrono::steady_clock::now() - started;
+                result.timings = transcoder.timings();
+
+                return result;
+            };
+
+            auto record_part = [&request, &tracker](size_t part_index, transcoded_part const& part)
+            {
+                tracker.part_done(part_index, part);
+
+                transcoded_frames.add(part.frames);
+                auto milliseconds = chrono::duration_cast<chrono::milliseconds>(part.elapsed).count();
+                if (part.frames && milliseconds > 0)
+                    transcode_fps.set(int64_t(part.frames * 1000 / uint64_t(milliseconds)));
+
+                if (part.timings.shared_audio)
+                {
+                    auto saved = uint64_t(chrono::duration_cast<chrono::milliseconds>(part.timings.shared_audio_saved).count());
+                    shared_audio.add(part.timings.shared_audio);
+                    shared_audio_saved.add(saved);
+                    trace::instant(join_path(request.path).first,
+                                   "shared_audio",
+                                   "audio encoded once for " + std::to_string(part.timings.shared_audio) +
+                                   " more profiles, saved " + std::to_string(saved) + " ms");
+                }
+            };
+
+            //  the segments are cut by one transcoder as it goes, so that every encoder runs
+            //  through the whole input, and each segment is sent as soon as every profile has it
+            if (segmented && false == parts.empty())
+            {
+                auto started = chrono::steady_clock::now();
+
+                transcoded_part part;
+                part.bounds = parts.front();
+                for (auto const& option : unchanged_options)
+                    part.options.push_back(std::make_pair(option, size_t(0)));
+
+                auto status_sent = started;
+
+                libavwrapper::transcoder transcoder;
+                transcoder.input_file = check_path(request.path).first;
+                transcoder.output_dir = request.output_dir;
+                transcoder.start = part.bounds.first;
+                transcoder.accurate = resume_off_bounds;
+                transcoder.probe_file = probe_file;
+                transcoder.segment_duration = *request.segment_duration;
+                transcoder.progress = [&tracker, &stream, &status_sent](libavwrapper::transcode_progress const& progress)
+                {
+                    tracker.update(0, progress);
+
+                    auto now = chrono::steady_clock::now();
+                    if (now - status_sent >= transcode_progress_period)
                     {
-                        InternalModel::ProcessMediaCheckResult response;
+                        status_sent = now;
+
+                        InternalModel::ProcessMediaCheckProgress message;
+                        message.status = TranscodeStatusVariant(packet(tracker.status()));
+                        stream.send(packet(std::move(message)));
+                    }
+
+                    storage_gate* pgate = pstorage_gate.load();
+                    if (pgate)
+                        pgate->wait();
+                };
+
+                transcoder.init(part.options);
+
+                uint64_t segment_start = part.bounds.first;
+                while (true)
+                {
+                    auto progress = transcoder.run();
+                    if (progress.empty())
+                        break;
+
+                    //  the last segment may be shorter in some profiles
+                    uint64_t segment_duration = 0;
+                    for (auto const& progress_item : progress)
+                        segment_duration = std::max(segment_duration, progress_item.second.duration);
+
+                    drop_empty(progress);
+
+                    vector<InternalModel::ProcessMediaCheckResult> responses;
+                    collect_progress(progress, part.options, segment_start, responses);
+                    segment_start += segment_duration;
+                    send_progress(responses, segment_start);
+
+                    part.progress.push_back(std::move(progress));
+                }
+
+                part.frames = transcoder.frames();
+                part.encoded_frames = transcoder.encoded_frames();
+                part.elapsed = chrono::steady_clock::now() - started;
+                part.timings = transcoder.timings();
 
-                        response.path = request.path;
-                        response.result_type = progress_item.second.result_type;
-                        response.type_description = unchanged_options[progress_item.first];
-                        response.type_description_refined = all_options[progress_item.first].first;
-                        response.accumulated = all_options[progress_item.first].second;
-                        response.count = progress_item.second.duration;
-                        response.data_or_file = progress_item.second.data_or_file;
+                record_part(0, part);
 
-                        all_options[progress_item.first].second += response.count;
+                parts.clear();
+            }
 
-                        stream.send(packet(std::move(response)));
+            std::deque<std::future<transcoded_part>> running;
+            beltpp::on_failure guard_running([&running]
+            {
+                for (auto& item : running)
+                {
+                    try
+                    {
+                        for (auto& progress : item.get().progress)
+                        for (auto& progress_item : progress)
+                        {
+                            boost::system::error_code ec;
+                            filesystem::remove(progress_item.second.data_or_file, ec);
+                        }
                     }
+                    catch (...)
+                    {}
                 }
+            });
+
+            size_t next_part = 0;
+            while (next_part != parts.size() || false == running.empty())
+            {
+                while (next_part != parts.size() && running.size() < transcode_threads)
+                {
+                    storage_gate* pgate = pstorage_gate.load();
+                    if (pgate)
+                        pgate->wait();
+
+                    string output_suffix;
+                    if (parts.size() > 1)
+                        output_suffix = "_" + std::to_string(next_part);
+
+                    running.push_back(std::async(std::launch::async,
+                                                 transcode_part,
+                                                 next_part,
+                                                 parts[next_part],
+                                                 resume_off_bounds && 0 == next_part,
+                                                 output_suffix));
+                    ++next_part;
+                }
+
+                while (std::future_status::ready != running.front().wait_for(transcode_progress_period))
+                {
+                    InternalModel::ProcessMediaCheckProgress message;
+                    message.status = TranscodeStatusVariant(packet(tracker.status()));
+                    stream.send(packet(std::move(message)));
+                }
+
+                size_t part_index = next_part - running.size();
+                auto part = running.front().get();
+                running.pop_front();
+                record_part(part_index, part);
+
+                bool part_done = false;
+                vector<InternalModel::ProcessMediaCheckResult> responses;
+                for (auto& progress : part.progress)
+                {
+                    drop_empty(progress);
+                    if (false == progress.empty())
+                        part_done = true;
+
+                    collect_progress(progress, part.options, part.bounds.first, responses);
+                }
+                send_progress(responses, part.bounds.second);
+
+                //  a part that failed ends the sequence, the following ones can't be appended
+                if (false == part_done)
+                    break;
             }
+
+            if (running.empty())
+                guard_running.dismiss();
+
+            InternalModel::ProcessMediaCheckResult response;
+            response.path = request.path;
+            response.count = 0;
+            response.accumulated = 0;
+
+            for (auto& option : all_options)
+                response.accumulated += option.second;
+
+            stream.send(packet(std::move(response)));
         }
         catch (...)
         {
@@ -252,7 +961,7 @@ stream_ptr construct_processor_wrap(beltpp::event_handler& eh,
                                     size_t count,
                                     beltpp::libprocessor::fpworker const& worker)
 {
-    auto result = beltpp::libprocessor::construct_processor(eh, 2, &processor_worker);
+    auto result = beltpp::libprocessor::construct_processor(eh, count, worker);
     eh.add(*result);
 
     return result;
@@ -262,22 +971,96 @@ class worker_internals
 {
 public:
     beltpp::ilog* plogger;
+    //  outlives the processor threads that wait on it
+    storage_gate gate;
     event_handler_ptr ptr_eh;
     stream_ptr ptr_stream;
     stream_ptr ptr_direct_stream;
+    spsc_ring<packet>& worker_results;
+    //  the results waiting for room in the ring, in order, at most a ring capacity of them
+    std::deque<packet> overflow;
+    std::mutex producer_mutex;
+    std::condition_variable producer_condition;
+    bool producer_woken;
     filesystem::path fs;
+    size_t transcode_threads;
+    uint64_t segment_duration;
+    cloudy::watcher watcher;
     wait_result wait_result_info;
 
     worker_internals(beltpp::ilog* _plogger,
                      filesystem::path const& _fs,
-                     beltpp::direct_channel& channel)
+                     beltpp::direct_channel& channel,
+                     spsc_ring<packet>& _worker_results,
+                     size_t threads,
+                     size_t _transcode_threads,
+                     uint64_t _segment_duration,
+                     uint64_t storage_in_flight_limit)
         : plogger(_plogger)
+        , gate(storage_in_flight_limit)
         , ptr_eh(beltpp::libprocessor::construct_event_handler())
-        , ptr_stream(construct_processor_wrap(*ptr_eh, 2, &processor_worker))
+        , ptr_stream(construct_processor_wrap(*ptr_eh, threads, &processor_worker))
         , ptr_direct_stream(beltpp::construct_direct_stream(worker_peerid, *ptr_eh, channel))
+        , worker_results(_worker_results)
+        , overflow()
+        , producer_mutex()
+        , producer_condition()
+        , producer_woken(false)
         , fs(_fs)
+        , transcode_threads(_transcode_threads)
+        , segment_duration(_segment_duration)
+        , watcher()
     {
-        //ptr_eh->set_timer(event_timer_period);
+        worker_results.set_producer_wake([this]
+        {
+            {
+                std::lock_guard<std::mutex> lock(producer_mutex);
+                producer_woken = true;
+            }
+            producer_condition.notify_one();
+            ptr_eh->wake();
+        });
+        pstorage_gate.store(&gate);
+
+        ptr_eh->set_timer(watcher_timer_period);
+    }
+
+    ~worker_internals()
+    {
+        //  the media checks in progress don't wait for the credits anymore
+        gate.close();
+        pstorage_gate.store(nullptr);
+    }
+
+    //  when admin falls behind, the results wait here until the ring has room
+    void send_to_admin(packet&& package)
+    {
+        if (false == overflow.empty() ||
+            false == worker_results.push(std::move(package)))
+            overflow.push_back(std::move(package));
+
+        //  admin is far behind. the processor results are not taken until it catches up,
+        //  so they don't pile up here. the wait is bounded, admin may be stopping
+        while (overflow.size() >= worker_results.capacity())
+        {
+            {
+                std::unique_lock<std::mutex> lock(producer_mutex);
+                if (false == producer_condition.wait_for(lock,
+                                                         overflow_wait_period,
+                                                         [this]{ return producer_woken; }))
+                    break;
+                producer_woken = false;
+            }
+
+            flush_overflow();
+        }
+    }
+
+    void flush_overflow()
+    {
+        while (false == overflow.empty() &&
+               worker_results.push(std::move(overflow.front())))
+            overflow.pop_front();
     }
 
     void writeln_node(string const& value)
@@ -299,10 +1082,20 @@ public:
  */
 worker::worker(beltpp::ilog* plogger,
                filesystem::path const& fs,
-               beltpp::direct_channel& channel)
+               beltpp::direct_channel& channel,
+               spsc_ring<packet>& worker_results,
+               size_t threads,
+               size_t transcode_threads,
+               uint64_t segment_duration,
+               uint64_t storage_in_flight_limit)
     : m_pimpl(new detail::worker_internals(plogger,
                                            fs,
-                                           channel))
+                                           channel,
+                                           worker_results,
+                                           threads,
+                                           transcode_threads,
+                                           segment_duration,
+                                           storage_in_flight_limit))
 {}
 worker::worker(worker&&) noexcept = default;
 worker::~worker() = default;
@@ -318,6 +1111,8 @@ void worker::run(bool& stop)
 
     unordered_set<beltpp::event_item const*> wait_sockets;
 
+    m_pimpl->flush_overflow();
+
     auto wait_result = detail::wait_and_receive_one(m_pimpl->wait_result_info,
                                                     *m_pimpl->ptr_eh,
                                                     *m_pimpl->ptr_stream,
@@ -333,7 +1128,7 @@ void worker::run(bool& stop)
 
         try
         {
-            m_pimpl->ptr_direct_stream->send(admin_peerid, std::move(received_packet));
+            m_pimpl->send_to_admin(std::move(received_packet));
         }
         catch (std::exception const& e)
         {
@@ -353,6 +1148,12 @@ void worker::run(bool& stop)
     else if (wait_result.et == detail::wait_result_item::timer)
     {
         m_pimpl->ptr_stream->timer_action();
+
+        InternalModel::WatchChanges changes;
+        changes.paths = m_pimpl->watcher.poll(watcher_settle_period);
+
+        if (false == changes.paths.empty())
+            m_pimpl->send_to_admin(packet(std::move(changes)));
     }
     else if (m_pimpl->ptr_direct_stream && wait_result.et == detail::wait_result_item::on_demand)
     {
@@ -370,13 +1171,34 @@ void worker::run(bool& stop)
                  received_packet.type() != beltpp::stream_drop::rtt)
                 )
             {
-                if (received_packet.type() == InternalModel::ProcessMediaCheckRequest::rtt)
+                if (received_packet.type() == InternalModel::StorageCredit::rtt)
+                {
+                    InternalModel::StorageCredit credit;
+                    std::move(received_packet).get(credit);
+
+                    m_pimpl->gate.acknowledged(credit.count);
+                }
+                else if (received_packet.type() == InternalModel::WatchRoots::rtt)
+                {
+                    InternalModel::WatchRoots roots;
+                    std::move(received_packet).get(roots);
+
+                    m_pimpl->watcher.reset(roots.roots);
+                    m_pimpl->writeln_node("watching " + std::to_string(roots.roots.size()) + " directories");
+                }
+                else
                 {
-                    InternalModel::ProcessMediaCheckRequest* p;
-                    received_packet.get(p);
-                    p->output_dir = m_pimpl->fs.string();
+                    if (received_packet.type() == InternalModel::ProcessMediaCheckRequest::rtt)
+                    {
+                        InternalModel::ProcessMediaCheckRequest* p;
+                        received_packet.get(p);
+                        p->output_dir = m_pimpl->fs.string();
+                        p->transcode_threads = m_pimpl->transcode_threads;
+                        if (m_pimpl->segment_duration)
+                            p->segment_duration = m_pimpl->segment_duration;
+                    }
+                    m_pimpl->ptr_stream->send(string(), std::move(received_packet));
                 }
-                m_pimpl->ptr_stream->send(string(), std::move(received_packet));
             }
         }
         catch (std::exception const& e)
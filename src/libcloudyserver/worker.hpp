@@ -2,8 +2,10 @@
 
 #include "global.hpp"
 #include "internal_model.hpp"
+#include "spsc_ring.hpp"
 
 #include <belt.pp/ilog.hpp>
+#include <belt.pp/packet.hpp>
 #include <belt.pp/direct_stream.hpp>
 
 #include <boost/filesystem/path.hpp>
@@ -23,6 +25,9 @@ class work_unit
 public:
     uint64_t duration = 0;
     std::string data_or_file;
+    //  for the files, when known
+    std::string data_hash;
+    uint64_t data_size = 0;
     InternalModel::ResultType result_type;
 };
 
@@ -31,7 +36,12 @@ class CLOUDYSERVERSHARED_EXPORT worker
 public:
     worker(beltpp::ilog* plogger,
            boost::filesystem::path const& fs,
-           beltpp::direct_channel& channel);
+           beltpp::direct_channel& channel,
+           spsc_ring<beltpp::packet>& worker_results,
+           size_t threads,
+           size_t transcode_threads,
+           uint64_t segment_duration,
+           uint64_t storage_in_flight_limit);
     worker(worker&& other) noexcept;
     ~worker();
 